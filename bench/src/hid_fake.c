@@ -0,0 +1,197 @@
+/**
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#include <zephyr/kernel.h>
+#include <zephyr/usb/class/usb_hid.h>
+#include <string.h>
+#include <errno.h>
+
+#include "hid_fake.h"
+#include "hid_out.h"
+#include "keymap.h"
+
+#define REPORT_MAX 64
+#define TYPED_MAX  4096
+
+struct fake_ep {
+	struct k_timer poll;
+	bool busy;
+	uint8_t last[REPORT_MAX];
+	size_t last_len;
+	uint32_t reports;
+};
+
+static const struct device fake_devs[2];
+
+const struct device *const hid_fake_mouse = &fake_devs[0];
+const struct device *const hid_fake_kbd = &fake_devs[1];
+
+static struct fake_ep eps[ARRAY_SIZE(fake_devs)];
+
+static int32_t mouse_x;
+static int32_t mouse_y;
+
+static char typed[TYPED_MAX];
+static size_t typed_len;
+/* Dead key waiting for the space that completes it */
+static uint16_t dead_pending;
+
+static void type_char(char c)
+{
+	if (typed_len < sizeof(typed)) {
+		typed[typed_len++] = c;
+	}
+}
+
+/* Reverse keymap lookup, as the host would interpret a key press */
+static void decode_press(uint8_t mods, uint8_t usage)
+{
+	if (dead_pending != 0) {
+		uint16_t key = dead_pending;
+
+		dead_pending = 0;
+		if (usage == KEYMAP_USAGE(keymap_lookup(' '))) {
+			for (int c = 0; c < KEYMAP_SIZE; c++) {
+				if (keymap_active[c] == key) {
+					type_char(c);
+					return;
+				}
+			}
+		}
+	}
+
+	if (usage == HID_KEY_ENTER) {
+		type_char('\n');
+		return;
+	}
+
+	for (int c = 0; c < KEYMAP_SIZE; c++) {
+		uint16_t key = keymap_active[c];
+
+		if (key != 0 && KEYMAP_USAGE(key) == usage && KEYMAP_MODS(key) == mods) {
+			if (KEYMAP_IS_DEAD(key)) {
+				dead_pending = key;
+			} else {
+				type_char(c);
+			}
+			return;
+		}
+	}
+}
+
+static bool pressed(const uint8_t *report, size_t len, uint8_t usage)
+{
+	if (len == 8) {
+		return memchr(&report[2], usage, 6) != NULL;
+	}
+
+	/* NKRO bitmap */
+	return 2 + usage / 8 < len && (report[2 + usage / 8] & BIT(usage % 8));
+}
+
+static void decode_kbd(const uint8_t *prev, size_t prev_len, const uint8_t *report, size_t len)
+{
+	/* New presses in the order the host handles them */
+	if (len == 8) {
+		for (size_t i = 2; i < len; i++) {
+			if (report[i] != 0 && !pressed(prev, prev_len, report[i])) {
+				decode_press(report[0], report[i]);
+			}
+		}
+		return;
+	}
+
+	for (int usage = 1; usage < (int)(len - 2) * 8; usage++) {
+		if (pressed(report, len, usage) && !pressed(prev, prev_len, usage)) {
+			decode_press(report[0], usage);
+		}
+	}
+}
+
+static void poll_expiry(struct k_timer *timer)
+{
+	struct fake_ep *ep = CONTAINER_OF(timer, struct fake_ep, poll);
+
+	ep->busy = false;
+	hid_out_in_ready(&fake_devs[ep - eps]);
+}
+
+int hid_int_ep_write(const struct device *dev, const uint8_t *data, uint32_t data_len,
+		     uint32_t *bytes_ret)
+{
+	struct fake_ep *ep;
+	uint64_t now_us;
+
+	if (dev != hid_fake_mouse && dev != hid_fake_kbd) {
+		return -ENODEV;
+	}
+	ep = &eps[dev - fake_devs];
+
+	if (ep->busy) {
+		return -EAGAIN;
+	}
+	if (data_len > REPORT_MAX) {
+		return -EINVAL;
+	}
+
+	if (dev == hid_fake_kbd) {
+		decode_kbd(ep->last, ep->last_len, data, data_len);
+	} else if (data_len >= 3) {
+		mouse_x += (int8_t)data[1];
+		mouse_y += (int8_t)data[2];
+	}
+	memcpy(ep->last, data, data_len);
+	ep->last_len = data_len;
+	ep->reports++;
+	ep->busy = true;
+
+	/* The host picks the report up at its next poll */
+	now_us = k_ticks_to_us_floor64(k_uptime_ticks());
+	k_timer_start(&ep->poll,
+		      K_USEC(CONFIG_BENCH_HID_POLL_US - now_us % CONFIG_BENCH_HID_POLL_US),
+		      K_NO_WAIT);
+
+	if (bytes_ret != NULL) {
+		*bytes_ret = data_len;
+	}
+
+	return 0;
+}
+
+void hid_fake_reset(void)
+{
+	for (size_t i = 0; i < ARRAY_SIZE(eps); i++) {
+		k_timer_init(&eps[i].poll, poll_expiry, NULL);
+		eps[i].busy = false;
+		eps[i].last_len = 0;
+		eps[i].reports = 0;
+	}
+	typed_len = 0;
+	dead_pending = 0;
+	mouse_x = 0;
+	mouse_y = 0;
+}
+
+void hid_fake_wait_idle(void)
+{
+	for (size_t i = 0; i < ARRAY_SIZE(eps); i++) {
+		while (eps[i].busy) {
+			k_sleep(K_USEC(CONFIG_BENCH_HID_POLL_US));
+		}
+	}
+}
+
+void hid_fake_stats_get(struct hid_fake_stats *stats)
+{
+	stats->mouse_reports = eps[0].reports;
+	stats->kbd_reports = eps[1].reports;
+	stats->mouse_x = mouse_x;
+	stats->mouse_y = mouse_y;
+}
+
+const char *hid_fake_typed(size_t *len)
+{
+	*len = typed_len;
+
+	return typed;
+}
@@ -0,0 +1,40 @@
+/**
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#ifndef REVENGE_BENCH_HID_FAKE_H_
+#define REVENGE_BENCH_HID_FAKE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <zephyr/device.h>
+
+/*
+ * In-memory replacement for the USB HID class. hid_int_ep_write() records
+ * the report and a simulated host collects it at the next poll interval,
+ * completing it through hid_out_in_ready() like the real int_in_ready
+ * callback. Keyboard reports are decoded back into text so the output can
+ * be checked.
+ */
+
+extern const struct device *const hid_fake_mouse;
+extern const struct device *const hid_fake_kbd;
+
+struct hid_fake_stats {
+	uint32_t kbd_reports;
+	uint32_t mouse_reports;
+	/* Pointer offset summed from the mouse reports */
+	int32_t mouse_x;
+	int32_t mouse_y;
+};
+
+void hid_fake_reset(void);
+
+/* Wait until the host has collected every report written so far. */
+void hid_fake_wait_idle(void);
+
+void hid_fake_stats_get(struct hid_fake_stats *stats);
+
+/* Text the host would have seen typed since the last reset. */
+const char *hid_fake_typed(size_t *len);
+
+#endif /* REVENGE_BENCH_HID_FAKE_H_ */
@@ -0,0 +1,22 @@
+/**
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#ifndef REVENGE_BENCH_KEYMAP_REF_H_
+#define REVENGE_BENCH_KEYMAP_REF_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+ * US layout translation as the firmware did it before the keymap tables:
+ * range checks and switches per character. The generated "us" table must
+ * give the same keys, and it is timed against these.
+ */
+
+/* Usage ID of a character, or -1 when it cannot be typed. */
+int keymap_ref_usage(uint8_t ascii);
+
+/* Whether the character needs shift. */
+bool keymap_ref_shift(uint8_t ascii);
+
+#endif /* REVENGE_BENCH_KEYMAP_REF_H_ */
@@ -0,0 +1,564 @@
+/**
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#include <zephyr/kernel.h>
+#include <zephyr/usb/class/usb_hid.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#ifdef CONFIG_ARCH_POSIX
+#include <posix_board_if.h>
+#endif
+
+#include "bytecode.h"
+#include "hid_fake.h"
+#include "hid_out.h"
+#include "kbd.h"
+#include "keymap.h"
+#include "keymap_ref.h"
+#include "mouse.h"
+#include "path.h"
+#include "stream.h"
+#include "text.h"
+#include "text_parse.h"
+
+/* Printable text without escapes, so it must come back out verbatim */
+static const char corpus[] =
+	"The quick brown fox jumps over the lazy dog. "
+	"THE QUICK BROWN FOX JUMPS OVER THE LAZY DOG! "
+	"0123456789 ~`!@#$%^&*()-_=+[]{};:'\",.<>/?| "
+	"aaaa bbbb oooo llll ssss eeee mississippi bookkeeper";
+
+/* Integer part and two decimals of num / den */
+#define FIX2(num, den) (uint32_t)((num) / (den)), (uint32_t)(((num) * 100 / (den)) % 100)
+
+#define KEYMAP_ROUNDS 20000
+
+/*
+ * The generated US table must match the functions it replaced for every
+ * code point, then both are timed over all of them.
+ */
+static int bench_keymap(void)
+{
+	const char *prev = keymap_active_name();
+	const uint32_t chars = KEYMAP_ROUNDS * KEYMAP_SIZE;
+	volatile uint32_t sink;
+	uint32_t sum = 0;
+	uint64_t table_ns, ref_ns;
+	clock_t cpu;
+	int failed = 0;
+
+	if (keymap_select("us", 2) != 0) {
+		printk("  FAIL: us layout not compiled in\n");
+		return -1;
+	}
+
+	for (int c = 0; c < KEYMAP_SIZE; c++) {
+		int usage = keymap_ref_usage(c);
+		uint8_t mods = keymap_ref_shift(c) ? HID_KBD_MODIFIER_RIGHT_SHIFT : 0;
+		uint16_t want = usage < 0 ? 0 : KEYMAP_ENTRY(usage, mods);
+
+		if (keymap_lookup(c) != want) {
+			printk("  FAIL: 0x%02x is 0x%04x, was 0x%04x\n", c, keymap_lookup(c), want);
+			failed = -1;
+		}
+	}
+
+	cpu = clock();
+	for (uint32_t i = 0; i < chars; i++) {
+		sum += keymap_lookup(i % KEYMAP_SIZE);
+	}
+	table_ns = (uint64_t)(clock() - cpu) * NSEC_PER_SEC / CLOCKS_PER_SEC;
+
+	cpu = clock();
+	for (uint32_t i = 0; i < chars; i++) {
+		uint8_t c = i % KEYMAP_SIZE;
+
+		sum += keymap_ref_usage(c) + keymap_ref_shift(c);
+	}
+	ref_ns = (uint64_t)(clock() - cpu) * NSEC_PER_SEC / CLOCKS_PER_SEC;
+	sink = sum;
+	(void)sink;
+
+	keymap_select(prev, strlen(prev));
+
+	printk("keymap: %u chars, table %u.%02u cpu ns/char, functions %u.%02u cpu ns/char\n",
+	       chars, FIX2(table_ns, chars), FIX2(ref_ns, chars));
+	if (failed == 0) {
+		printk("  all %d code points translate as before\n", KEYMAP_SIZE);
+	}
+
+	return failed;
+}
+
+static int bench_text(uint8_t keys_per_report)
+{
+	struct kbd_stats stats;
+	struct hid_fake_stats fake;
+	const size_t chars = sizeof(corpus) - 1;
+	const char *typed;
+	size_t typed_len;
+	int64_t start_ms, sim_ms;
+	clock_t cpu;
+	uint64_t cpu_us;
+
+	hid_fake_reset();
+	kbd_set_keys_per_report(keys_per_report);
+	kbd_stats_get(&stats, true);
+
+	start_ms = k_uptime_get();
+	cpu = clock();
+
+	text_run((const uint8_t *)corpus, chars);
+	hid_out_drain();
+	hid_fake_wait_idle();
+
+	cpu = clock() - cpu;
+	sim_ms = k_uptime_get() - start_ms;
+	cpu_us = (uint64_t)cpu * USEC_PER_SEC / CLOCKS_PER_SEC;
+
+	kbd_stats_get(&stats, false);
+	hid_fake_stats_get(&fake);
+	typed = hid_fake_typed(&typed_len);
+
+	printk("text k=%u: %u chars in %lld ms, %u.%02u chars/s, %u.%02u reports/char, "
+	       "%u.%02u cpu us/char\n",
+	       keys_per_report, (uint32_t)chars, sim_ms,
+	       FIX2((uint64_t)chars * MSEC_PER_SEC, MAX(sim_ms, 1)),
+	       FIX2((uint64_t)fake.kbd_reports, chars),
+	       FIX2(cpu_us, chars));
+	printk("  kbd: %u keys in %u reports\n", stats.keys, stats.reports);
+
+	if (typed_len != chars || memcmp(typed, corpus, chars) != 0) {
+		printk("  FAIL: host saw \"%.*s\"\n", (int)typed_len, typed);
+		return -1;
+	}
+
+	return 0;
+}
+
+static int bench_mouse(void)
+{
+	struct hid_fake_stats fake;
+	int64_t start_ms, sim_ms;
+	clock_t cpu;
+	uint64_t cpu_us;
+
+	hid_fake_reset();
+
+	start_ms = k_uptime_get();
+	cpu = clock();
+
+	mouse_rotate(1);
+	while (mouse_busy()) {
+		k_sleep(K_MSEC(10));
+	}
+	hid_out_drain();
+	hid_fake_wait_idle();
+
+	cpu = clock() - cpu;
+	sim_ms = k_uptime_get() - start_ms;
+	cpu_us = (uint64_t)cpu * USEC_PER_SEC / CLOCKS_PER_SEC;
+	hid_fake_stats_get(&fake);
+
+	printk("mouse rotate: %u reports in %lld ms, %u.%02u reports/s, %u.%02u cpu us/report\n",
+	       fake.mouse_reports, sim_ms,
+	       FIX2((uint64_t)fake.mouse_reports * MSEC_PER_SEC, MAX(sim_ms, 1)),
+	       FIX2(cpu_us, MAX(fake.mouse_reports, 1)));
+
+	/* A whole turn, the pointer must be back where it started */
+	if (fake.mouse_x != 0 || fake.mouse_y != 0) {
+		printk("  FAIL: pointer ended at %d,%d\n", fake.mouse_x, fake.mouse_y);
+		return -1;
+	}
+
+	return 0;
+}
+
+/* Typing while the mouse circles, the two endpoints are fed independently */
+static int bench_both(void)
+{
+	struct hid_fake_stats fake;
+	const size_t chars = sizeof(corpus) - 1;
+	const char *typed;
+	size_t typed_len;
+	int64_t start_ms, text_ms, sim_ms;
+
+	hid_fake_reset();
+	kbd_set_keys_per_report(1);
+
+	start_ms = k_uptime_get();
+
+	mouse_rotate(1);
+	text_run((const uint8_t *)corpus, chars);
+	text_ms = k_uptime_get() - start_ms;
+	while (mouse_busy()) {
+		k_sleep(K_MSEC(10));
+	}
+	hid_out_drain();
+	hid_fake_wait_idle();
+
+	sim_ms = k_uptime_get() - start_ms;
+	hid_fake_stats_get(&fake);
+	typed = hid_fake_typed(&typed_len);
+
+	printk("text + mouse: %lld ms, text done after %lld ms, %u kbd and %u mouse reports\n",
+	       sim_ms, text_ms, fake.kbd_reports, fake.mouse_reports);
+
+	if (typed_len != chars || memcmp(typed, corpus, chars) != 0) {
+		printk("  FAIL: host saw \"%.*s\"\n", (int)typed_len, typed);
+		return -1;
+	}
+
+	return 0;
+}
+
+#define SPLIT_DELAYS 24
+
+/*
+ * A program with a DELAY before every few keys, played through the stream
+ * like chunks that arrive one by one. Cut at every size up to the whole
+ * program, so each DELAY and KEYS is split at every byte once, the host
+ * must see all of the keys.
+ */
+static int bench_stream_split(void)
+{
+	static uint8_t prog[1 + SPLIT_DELAYS * (3 + 2 + 2 * 3)];
+	char expect[SPLIT_DELAYS * 3];
+	size_t len = 0;
+	int failed = 0;
+
+	prog[len++] = BC_MAGIC;
+	for (size_t i = 0; i < sizeof(expect); i++) {
+		uint16_t key;
+
+		if (i % 3 == 0) {
+			prog[len++] = BC_OP_DELAY;
+			prog[len++] = 1;
+			prog[len++] = 0;
+			prog[len++] = BC_OP_KEYS;
+			prog[len++] = 3;
+		}
+		expect[i] = corpus[i];
+		key = keymap_lookup(expect[i]);
+		prog[len++] = KEYMAP_MODS(key);
+		prog[len++] = KEYMAP_USAGE(key);
+	}
+
+	for (size_t chunk = 1; chunk <= len && failed == 0; chunk++) {
+		const char *typed;
+		size_t typed_len;
+
+		hid_fake_reset();
+		kbd_set_keys_per_report(1);
+
+		for (size_t pos = 0; pos < len; pos += chunk) {
+			size_t n = MIN(chunk, len - pos);
+			size_t done = 0;
+			uint32_t wait_ms;
+
+			/* Like the player, the rest of a chunk goes on after a wait */
+			do {
+				done += stream_feed(&prog[pos + done], n - done, pos == 0 && done == 0,
+						    pos + n == len, &wait_ms);
+				k_sleep(K_MSEC(wait_ms));
+			} while (done < n || wait_ms > 0);
+		}
+		hid_out_drain();
+		hid_fake_wait_idle();
+
+		typed = hid_fake_typed(&typed_len);
+		if (typed_len != sizeof(expect) || memcmp(typed, expect, typed_len) != 0) {
+			printk("  FAIL: in chunks of %u bytes the host saw \"%.*s\"\n",
+			       (uint32_t)chunk, (int)typed_len, typed);
+			failed = -1;
+		}
+	}
+
+	printk("stream: %u byte program with %d delays, split at every size\n", (uint32_t)len,
+	       SPLIT_DELAYS);
+
+	return failed;
+}
+
+/* xorshift32, the same sequence on every run */
+static uint32_t rand_state;
+
+static uint32_t rand_next(void)
+{
+	rand_state ^= rand_state << 13;
+	rand_state ^= rand_state >> 17;
+	rand_state ^= rand_state << 5;
+
+	return rand_state;
+}
+
+/* Text with every kind of command, to be parsed but not typed */
+static const char *const parse_pieces[] = {
+	"The quick brown fox ", "jumps over the lazy dog. ", "0123456789 ", "~!@#$%^&*() ",
+	"\\n", "\\t", "\\c", "\\s", "\\m", "\\q", "\\\\", "\\p", "\\p25", "\\p1000",
+	"\\k", "\\k3", "\\lde ", "\\lnordic", "\\lus\\n",
+};
+
+static const char parse_url[] = "\\xhttps://example.com/?q=\\n";
+
+static uint8_t parse_input[16384];
+static size_t parse_input_len;
+
+static void parse_input_fill(void)
+{
+	size_t len = 0;
+
+	rand_state = 0x2545F491;
+
+	for (;;) {
+		const char *piece = parse_pieces[rand_next() % ARRAY_SIZE(parse_pieces)];
+		size_t n = strlen(piece);
+
+		if (len + n > sizeof(parse_input) - 64) {
+			break;
+		}
+		memcpy(&parse_input[len], piece, n);
+		len += n;
+	}
+
+	/* A URL runs to the end of the payload */
+	memcpy(&parse_input[len], parse_url, sizeof(parse_url) - 1);
+	parse_input_len = len + sizeof(parse_url) - 1;
+}
+
+/* FNV-1a over the commands, plain text byte by byte so splits do not show */
+static uint32_t digest_add(uint32_t hash, const void *data, size_t len)
+{
+	for (size_t i = 0; i < len; i++) {
+		hash = (hash ^ ((const uint8_t *)data)[i]) * 16777619;
+	}
+
+	return hash;
+}
+
+static uint32_t parse_split(size_t max_chunk, uint32_t *cmds)
+{
+	struct text_parser parser;
+	struct text_cmd cmd;
+	uint32_t hash = 2166136261;
+	size_t pos = 0;
+	size_t used;
+
+	text_parse_init(&parser);
+	*cmds = 0;
+
+	do {
+		size_t n = max_chunk > 0 ? 1 + rand_next() % max_chunk : parse_input_len;
+		const uint8_t *chunk = &parse_input[pos];
+		bool last;
+
+		n = MIN(n, parse_input_len - pos);
+		last = pos + n == parse_input_len;
+
+		while (text_parse(&parser, chunk, n, last, &used, &cmd)) {
+			chunk += used;
+			n -= used;
+			(*cmds)++;
+			if (cmd.op == TEXT_OP_TEXT) {
+				for (size_t i = 0; i < cmd.arg; i++) {
+					hash = digest_add(hash, &cmd.op, sizeof(cmd.op));
+					hash = digest_add(hash, &cmd.str[i], 1);
+				}
+			} else {
+				hash = digest_add(hash, &cmd.op, sizeof(cmd.op));
+				hash = digest_add(hash, &cmd.arg, sizeof(cmd.arg));
+				if (cmd.op == TEXT_OP_LAYOUT || cmd.op == TEXT_OP_URL ||
+				    cmd.op == TEXT_OP_URL_MOUSE) {
+					hash = digest_add(hash, cmd.str, cmd.arg);
+				}
+			}
+		}
+		pos = chunk + used - parse_input;
+	} while (pos < parse_input_len);
+
+	return hash;
+}
+
+/*
+ * A URL as long as the parser holds comes out whole, a longer one or a
+ * long layout name must be rejected instead of cut off, however it is split.
+ */
+static int parse_long(void)
+{
+	static uint8_t input[2 + TEXT_PARSE_STR_MAX + 1];
+	static const struct {
+		char cmd;
+		size_t len;
+		enum text_op op;
+	} cases[] = {
+		{ 'x', TEXT_PARSE_STR_MAX, TEXT_OP_URL_MOUSE },
+		{ 'x', TEXT_PARSE_STR_MAX + 1, TEXT_OP_TOO_LONG },
+		{ 'l', TEXT_PARSE_STR_MAX + 1, TEXT_OP_TOO_LONG },
+	};
+	int failed = 0;
+
+	for (size_t c = 0; c < ARRAY_SIZE(cases); c++) {
+		size_t len = 2 + cases[c].len;
+
+		input[0] = '\\';
+		input[1] = cases[c].cmd;
+		for (size_t i = 2; i < len; i++) {
+			input[i] = 'a' + i % 26;
+		}
+
+		for (size_t chunk = 1; chunk <= len; chunk += chunk < 8 ? 1 : 61) {
+			struct text_parser parser;
+			struct text_cmd cmd;
+			uint32_t cmds = 0;
+			bool ok = false;
+			size_t used;
+
+			text_parse_init(&parser);
+			for (size_t pos = 0; pos < len; pos += chunk) {
+				const uint8_t *data = &input[pos];
+				size_t n = MIN(chunk, len - pos);
+				bool last = pos + n == len;
+
+				while (text_parse(&parser, data, n, last, &used, &cmd)) {
+					data += used;
+					n -= used;
+					cmds++;
+					ok = cmd.op == cases[c].op &&
+					     (cmd.op == TEXT_OP_TOO_LONG ||
+					      (cmd.arg == cases[c].len &&
+					       memcmp(cmd.str, &input[2], cmd.arg) == 0));
+				}
+			}
+
+			if (cmds != 1 || !ok) {
+				printk("  FAIL: \\%c with %u characters in chunks of %u\n",
+				       cases[c].cmd, (uint32_t)cases[c].len, (uint32_t)chunk);
+				failed = -1;
+			}
+		}
+	}
+
+	return failed;
+}
+
+/* The parser alone: throughput, and the same commands however it is split */
+static int bench_parse(void)
+{
+	const int rounds = 64;
+	const int splits = 500;
+	uint32_t cmds, split_cmds;
+	uint32_t ref;
+	clock_t cpu;
+	uint64_t cpu_us;
+	int failed = 0;
+
+	parse_input_fill();
+	ref = parse_split(0, &cmds);
+
+	cpu = clock();
+	for (int i = 0; i < rounds; i++) {
+		(void)parse_split(0, &cmds);
+	}
+	cpu = clock() - cpu;
+	cpu_us = MAX((uint64_t)cpu * USEC_PER_SEC / CLOCKS_PER_SEC, 1);
+
+	printk("parse: %u bytes, %u commands, %llu bytes/s\n", (uint32_t)parse_input_len, cmds,
+	       (uint64_t)parse_input_len * rounds * USEC_PER_SEC / cpu_us);
+
+	for (int i = 0; i < splits; i++) {
+		/* From single bytes up to about a NUS write */
+		size_t max_chunk = i < splits / 2 ? 1 + i % 8 : 1 + rand_next() % 500;
+
+		if (parse_split(max_chunk, &split_cmds) != ref) {
+			printk("  FAIL: chunks of up to %u bytes parse differently\n",
+			       (uint32_t)max_chunk);
+			failed = -1;
+			break;
+		}
+	}
+	if (failed == 0) {
+		printk("  %d random splits parse the same\n", splits);
+	}
+
+	failed |= parse_long();
+
+	return failed;
+}
+
+/*
+ * Full turns over every radius up to the largest an int16 centre allows,
+ * in several directions. No report may leave the int8 range and each turn
+ * must end where it started.
+ */
+static int bench_path(void)
+{
+	static const int16_t dirs[][2] = {
+		{ 1, 0 }, { 0, -1 }, { -1, -1 }, { 3, -4 }, { -12, 5 },
+	};
+	uint32_t arcs = 0;
+	uint32_t reports = 0;
+	int32_t worst = 0;
+	int failed = 0;
+
+	for (int32_t r = 1; r <= 46341; r += r < 256 ? 1 : r / 64) {
+		for (size_t d = 0; d < ARRAY_SIZE(dirs); d++) {
+			int32_t norm = MAX(abs(dirs[d][0]), abs(dirs[d][1]));
+			int16_t cx = CLAMP(dirs[d][0] * r / norm, INT16_MIN, INT16_MAX);
+			int16_t cy = CLAMP(dirs[d][1] * r / norm, INT16_MIN, INT16_MAX);
+			int32_t x = 0, y = 0, px = 0, py = 0;
+			struct path path;
+
+			path_arc(&path, cx, cy, d % 2 ? -360 : 360);
+			while (path_next(&path, &x, &y)) {
+				worst = MAX(worst, MAX(abs(x - px), abs(y - py)));
+				px = x;
+				py = y;
+			}
+			arcs++;
+			reports += path_steps(&path);
+
+			if (x != 0 || y != 0) {
+				printk("  FAIL: arc around %d,%d ended at %d,%d\n", cx, cy, x, y);
+				failed = -1;
+			}
+		}
+	}
+
+	printk("paths: %u arcs, %u reports, largest step %d\n", arcs, reports, worst);
+	if (worst > PATH_STEP_MAX) {
+		printk("  FAIL: step over %d\n", PATH_STEP_MAX);
+		failed = -1;
+	}
+
+	return failed;
+}
+
+int main(void)
+{
+	int failed = 0;
+
+	hid_out_init(hid_fake_mouse, hid_fake_kbd);
+	mouse_init(&k_sys_work_q);
+
+	printk("HID bench, poll interval %u us, min report interval %u us\n",
+	       CONFIG_BENCH_HID_POLL_US, hid_out_get_min_interval());
+
+	failed |= bench_keymap();
+	failed |= bench_text(1);
+	failed |= bench_text(6);
+	failed |= bench_mouse();
+	failed |= bench_both();
+	failed |= bench_stream_split();
+	failed |= bench_parse();
+	failed |= bench_path();
+
+	printk("%s\n", failed ? "FAILED" : "PASSED");
+
+#ifdef CONFIG_ARCH_POSIX
+	posix_exit(failed ? 1 : 0);
+#endif
+
+	return 0;
+}
@@ -0,0 +1,28 @@
+# SPDX-License-Identifier: Apache-2.0
+#
+# Keyboard layout tables for the Zephyr app target. The layout selected in
+# Kconfig comes first and is active at boot, the others are only built in
+# for runtime switching.
+
+set(REVENGE_ROOT ${CMAKE_CURRENT_LIST_DIR}/..)
+
+function(revenge_keymap_sources)
+  set(layout_dir ${REVENGE_ROOT}/layouts)
+  set(layouts ${layout_dir}/${CONFIG_REVENGE_LAYOUT_NAME}.layout)
+  if(CONFIG_REVENGE_LAYOUT_RUNTIME_SWITCH)
+    FILE(GLOB all_layouts ${layout_dir}/*.layout)
+    list(REMOVE_ITEM all_layouts ${layouts})
+    list(APPEND layouts ${all_layouts})
+  endif()
+
+  set(keymap_gen ${CMAKE_CURRENT_BINARY_DIR}/generated/keymap_layouts.c)
+  add_custom_command(
+    OUTPUT ${keymap_gen}
+    COMMAND ${CMAKE_COMMAND} -E make_directory ${CMAKE_CURRENT_BINARY_DIR}/generated
+    COMMAND ${PYTHON_EXECUTABLE} ${REVENGE_ROOT}/scripts/gen_keymap.py
+            -o ${keymap_gen} ${layouts}
+    DEPENDS ${REVENGE_ROOT}/scripts/gen_keymap.py ${layouts}
+    COMMENT "Generating keyboard layout tables"
+  )
+  target_sources(app PRIVATE ${keymap_gen})
+endfunction()
@@ -0,0 +1,144 @@
+#!/usr/bin/env python3
+# SPDX-License-Identifier: Apache-2.0
+"""Compile keyboard layout descriptions into ASCII to HID lookup tables.
+
+Each layout file lists one character per line:
+
+    <char> <key> [shift] [altgr] [dead]
+
+<char> is the literal character, or 0xNN for '#', space and anything
+else awkward to write. <key> names the physical key by its US-QWERTY
+legend (see KEYS below). 'dead' marks dead keys, which the firmware
+follows with a space to get the bare character. Lines starting with '#'
+are comments. Characters that are not listed cannot be typed.
+
+The output is a C file defining one 128-entry table per layout in the
+format described in src/keymap.h, plus the keymap_layouts[] index. The
+first layout given is the one active at boot.
+"""
+
+import argparse
+import os
+import sys
+
+KEYS = {
+    **{chr(c): 0x04 + c - ord('a') for c in range(ord('a'), ord('z') + 1)},
+    **{str(d): 0x1E + (d - 1) for d in range(1, 10)},
+    '0': 0x27,
+    'enter': 0x28,
+    'esc': 0x29,
+    'backspace': 0x2A,
+    'tab': 0x2B,
+    'space': 0x2C,
+    'minus': 0x2D,
+    'equal': 0x2E,
+    'leftbrace': 0x2F,
+    'rightbrace': 0x30,
+    'backslash': 0x31,
+    'hash': 0x32,        # Non-US # and ~, next to Enter on ISO boards
+    'semicolon': 0x33,
+    'apostrophe': 0x34,
+    'grave': 0x35,
+    'comma': 0x36,
+    'dot': 0x37,
+    'slash': 0x38,
+    'delete': 0x4C,
+    '102nd': 0x64,       # Non-US \ and |, next to left shift on ISO boards
+}
+
+MODS = {
+    'shift': 0x20,       # HID_KBD_MODIFIER_RIGHT_SHIFT
+    'altgr': 0x40,       # HID_KBD_MODIFIER_RIGHT_ALT
+}
+
+DEAD = 0x80
+TABLE_SIZE = 128
+
+
+def parse_char(tok):
+    if len(tok) == 1:
+        return ord(tok)
+    if tok.startswith('0x'):
+        return int(tok, 16)
+    raise ValueError(f"bad character '{tok}'")
+
+
+def parse_layout(path):
+    table = [0] * TABLE_SIZE
+    with open(path, encoding='ascii') as f:
+        for lineno, line in enumerate(f, 1):
+            fields = line.split()
+            if not fields or line.startswith('#'):
+                continue
+            where = f"{path}:{lineno}"
+            try:
+                char = parse_char(fields[0])
+            except ValueError as e:
+                sys.exit(f"{where}: {e}")
+            if char >= TABLE_SIZE:
+                sys.exit(f"{where}: character 0x{char:02x} is not ASCII")
+            if table[char]:
+                sys.exit(f"{where}: character 0x{char:02x} defined twice")
+            if len(fields) < 2 or fields[1] not in KEYS:
+                sys.exit(f"{where}: unknown key")
+
+            entry = KEYS[fields[1]]
+            for flag in fields[2:]:
+                if flag == 'dead':
+                    entry |= DEAD
+                elif flag in MODS:
+                    entry |= MODS[flag] << 8
+                else:
+                    sys.exit(f"{where}: unknown flag '{flag}'")
+            table[char] = entry
+    return table
+
+
+def c_char(c):
+    if c == ord("'") or c == ord('\\'):
+        return f"'\\{chr(c)}'"
+    if 0x20 <= c < 0x7F:
+        return f"'{chr(c)}'"
+    return f"0x{c:02X}"
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__,
+                                     formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument('-o', '--output', required=True)
+    parser.add_argument('layouts', nargs='+')
+    args = parser.parse_args()
+
+    out = ["/* Generated by gen_keymap.py, do not edit */",
+           "#include <stddef.h>",
+           "",
+           '#include "keymap.h"',
+           ""]
+    names = []
+    for path in args.layouts:
+        name = os.path.splitext(os.path.basename(path))[0]
+        table = parse_layout(path)
+        names.append(name)
+        out.append(f"static const uint16_t keymap_{name}[KEYMAP_SIZE] = {{")
+        for c, entry in enumerate(table):
+            if entry:
+                out.append(f"\t[{c_char(c)}] = 0x{entry:04X},")
+        out.append("};")
+        out.append("")
+
+    out.append("const struct keymap_layout keymap_layouts[] = {")
+    for name in names:
+        out.append(f'\t{{ "{name}", keymap_{name} }},')
+    out.append("};")
+    out.append("")
+    out.append("const size_t keymap_layout_count = "
+               "sizeof(keymap_layouts) / sizeof(keymap_layouts[0]);")
+    out.append("")
+    out.append(f"const uint16_t *keymap_active = keymap_{names[0]};")
+
+    with open(args.output, 'w', encoding='ascii') as f:
+        f.write("\n".join(out) + "\n")
+
+
+if __name__ == '__main__':
+    main()
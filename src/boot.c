@@ -0,0 +1,43 @@
+/**
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#include <zephyr/kernel.h>
+#include <zephyr/sys/atomic.h>
+#include <zephyr/logging/log.h>
+#ifdef CONFIG_TRACING
+#include <zephyr/tracing/tracing.h>
+#endif
+
+#include "boot.h"
+
+LOG_MODULE_REGISTER(boot);
+
+static const char *const names[BOOT_POINT_COUNT] = {
+	[BOOT_MAIN] = "main",
+	[BOOT_BT_READY] = "bt_ready",
+	[BOOT_ADVERTISING] = "advertising",
+	[BOOT_USB_CONFIGURED] = "usb_configured",
+};
+
+static atomic_t marks_us[BOOT_POINT_COUNT];
+
+void boot_mark(enum boot_point point)
+{
+	/* Never 0, which stands for not reached */
+	uint32_t us = MAX(k_ticks_to_us_floor32(k_uptime_ticks()), 1);
+
+	if (!atomic_cas(&marks_us[point], 0, us)) {
+		return;
+	}
+
+	LOG_INF("Boot: %s at %u us", names[point], us);
+
+#ifdef CONFIG_TRACING
+	sys_trace_named_event(names[point], us, 0);
+#endif
+}
+
+uint32_t boot_time_us(enum boot_point point)
+{
+	return atomic_get(&marks_us[point]);
+}
@@ -0,0 +1,28 @@
+/**
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#ifndef REVENGE_BOOT_H_
+#define REVENGE_BOOT_H_
+
+#include <stdint.h>
+
+/*
+ * Startup tracepoints. Each point is logged with the time since the kernel
+ * started the first time it is reached, and emitted as a named tracing
+ * event when tracing is enabled, so the startup budget can be followed.
+ */
+
+enum boot_point {
+	BOOT_MAIN,
+	BOOT_BT_READY,
+	BOOT_ADVERTISING,
+	BOOT_USB_CONFIGURED,
+	BOOT_POINT_COUNT,
+};
+
+void boot_mark(enum boot_point point);
+
+/* Microseconds from kernel start to the point, 0 if not reached yet. */
+uint32_t boot_time_us(enum boot_point point);
+
+#endif /* REVENGE_BOOT_H_ */
@@ -0,0 +1,294 @@
+/**
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#include <zephyr/kernel.h>
+#include <zephyr/sys/byteorder.h>
+#include <zephyr/logging/log.h>
+#include <errno.h>
+
+#include "bytecode.h"
+#include "hid_out.h"
+#include "kbd.h"
+#include "keymap.h"
+#include "mouse.h"
+
+LOG_MODULE_REGISTER(bytecode);
+
+/*
+ * Bail out unless n more operand bytes are available. Checked before an
+ * instruction has any effect, so a streamed program can run it again once
+ * the rest has arrived.
+ */
+#define NEED(n)                                                  \
+	do {                                                     \
+		if ((size_t)(limit - pc) < (size_t)(n)) {        \
+			return -ENODATA;                         \
+		}                                                \
+	} while (0)
+
+/*
+ * A REPEAT being run. Offsets are from the outermost REPEAT, which stays
+ * with the caller while a DELAY inside it waits.
+ */
+struct frame {
+	uint32_t body;
+	uint32_t end;
+	/* Runs left after the current one */
+	uint8_t left;
+};
+
+/* Checked before any of the keys is pressed, they come straight from the sender */
+static bool usages_valid(const uint8_t *pairs, size_t n)
+{
+	for (size_t i = 0; i < n; i++) {
+		if (pairs[2 * i + 1] >= KBD_USAGES) {
+			LOG_ERR("Invalid key usage 0x%02x", pairs[2 * i + 1]);
+			return false;
+		}
+	}
+
+	return true;
+}
+
+static struct frame frames[BC_MAX_DEPTH];
+static int depth;
+/* Where to go on inside the repeats once a wait is over */
+static uint32_t resume;
+
+/*
+ * Runs until end, an END opcode or a wait. stop is left at the next
+ * top-level instruction, or at the REPEAT that a wait happened in.
+ */
+static int run(const uint8_t *pc, const uint8_t *end, uint32_t *wait_ms,
+	       const uint8_t **stop)
+{
+	/* Start of the outermost REPEAT being run */
+	const uint8_t *base = pc;
+	int ret = 0;
+
+	if (depth > 0) {
+		pc += resume;
+	}
+
+	while (ret == 0 && *wait_ms == 0) {
+		const uint8_t *limit = depth > 0 ? base + frames[depth - 1].end : end;
+		uint8_t op;
+		uint8_t n;
+
+		if (pc >= limit) {
+			if (depth == 0) {
+				break;
+			}
+			if (frames[depth - 1].left > 0) {
+				frames[depth - 1].left--;
+				pc = base + frames[depth - 1].body;
+			} else {
+				depth--;
+			}
+			continue;
+		}
+
+		if (depth == 0) {
+			base = pc;
+		}
+		*stop = base;
+		op = *pc++;
+
+		switch (op) {
+		case BC_OP_END:
+			if (depth == 0) {
+				return 1;
+			}
+			/* Ends the current run of the body */
+			pc = limit;
+			break;
+		case BC_OP_TYPE:
+			NEED(1);
+			n = *pc++;
+			NEED(n);
+			for (; n > 0 && ret == 0; n--) {
+				uint16_t key = keymap_lookup(*pc++);
+
+				if (key != 0) {
+					ret = kbd_type(key);
+				}
+			}
+			pc += n;
+			break;
+		case BC_OP_KEYS:
+			NEED(1);
+			n = *pc++;
+			NEED(2 * n);
+			if (!usages_valid(pc, n)) {
+				return -EINVAL;
+			}
+			for (; n > 0 && ret == 0; n--, pc += 2) {
+				ret = kbd_tap(pc[0], pc[1]);
+			}
+			pc += 2 * n;
+			break;
+		case BC_OP_COMBO:
+			NEED(2);
+			if (!usages_valid(pc, 1)) {
+				return -EINVAL;
+			}
+			ret = kbd_tap(pc[0], pc[1]);
+			if (ret == 0) {
+				ret = kbd_release();
+			}
+			pc += 2;
+			break;
+		case BC_OP_RELEASE:
+			ret = kbd_release();
+			break;
+		case BC_OP_DELAY:
+			NEED(2);
+			ret = kbd_release();
+			*wait_ms = sys_get_le16(pc);
+			pc += 2;
+			break;
+		case BC_OP_MOUSE:
+			NEED(5);
+			ret = mouse_move(pc[0], (int16_t)sys_get_le16(&pc[1]),
+					 (int16_t)sys_get_le16(&pc[3]));
+			pc += 5;
+			break;
+		case BC_OP_ROTATE:
+			NEED(1);
+			ret = kbd_release();
+			mouse_rotate(*pc++);
+			break;
+		case BC_OP_REPEAT: {
+			uint8_t count;
+			uint16_t len;
+
+			NEED(3);
+			count = pc[0];
+			len = sys_get_le16(&pc[1]);
+			pc += 3;
+			NEED(len);
+			if (depth >= BC_MAX_DEPTH) {
+				LOG_ERR("Repeat nested too deep");
+				return -EINVAL;
+			}
+			if (count > 0) {
+				frames[depth].body = pc - base;
+				frames[depth].end = pc + len - base;
+				frames[depth].left = count - 1;
+				depth++;
+			} else {
+				pc += len;
+			}
+			break;
+		}
+		case BC_OP_LAYOUT:
+			NEED(1);
+			n = *pc++;
+			NEED(n);
+			if (keymap_select((const char *)pc, n) != 0) {
+				LOG_WRN("Layout %.*s not compiled in", n, pc);
+			}
+			pc += n;
+			break;
+		case BC_OP_PACE:
+			NEED(2);
+			hid_out_set_min_interval(sys_get_le16(pc) * USEC_PER_MSEC);
+			pc += 2;
+			break;
+		case BC_OP_PACK:
+			NEED(1);
+			/* Only pacing, the program goes on as it would in text */
+			if (kbd_set_keys_per_report(*pc) != 0) {
+				LOG_WRN("%u keys per report not supported", *pc);
+			}
+			pc++;
+			break;
+		case BC_OP_HOME:
+			ret = mouse_home();
+			break;
+		case BC_OP_MOVETO:
+			NEED(5);
+			ret = mouse_move_to(pc[0], (int16_t)sys_get_le16(&pc[1]),
+					    (int16_t)sys_get_le16(&pc[3]));
+			pc += 5;
+			break;
+		case BC_OP_ARC:
+			NEED(7);
+			ret = mouse_arc(pc[0], (int16_t)sys_get_le16(&pc[1]),
+					(int16_t)sys_get_le16(&pc[3]), (int16_t)sys_get_le16(&pc[5]));
+			pc += 7;
+			break;
+		case BC_OP_CURVE:
+			NEED(13);
+			ret = mouse_curve(pc[0], (int16_t)sys_get_le16(&pc[1]),
+					  (int16_t)sys_get_le16(&pc[3]), (int16_t)sys_get_le16(&pc[5]),
+					  (int16_t)sys_get_le16(&pc[7]), (int16_t)sys_get_le16(&pc[9]),
+					  (int16_t)sys_get_le16(&pc[11]));
+			pc += 13;
+			break;
+		default:
+			LOG_ERR("Unknown opcode 0x%02x", op);
+			return -EINVAL;
+		}
+	}
+
+	if (depth > 0) {
+		resume = pc - base;
+	} else {
+		*stop = pc;
+	}
+
+	return ret;
+}
+
+int bc_feed(const uint8_t *code, size_t len, bool last, size_t *used, uint32_t *wait_ms)
+{
+	const uint8_t *stop = code;
+	int ret;
+
+	*wait_ms = 0;
+
+	ret = run(code, code + len, wait_ms, &stop);
+	if (ret == -ENODATA) {
+		if (depth > 0) {
+			/* The whole body is there, it is cut off inside */
+			LOG_ERR("Truncated opcode in repeat");
+			ret = -EINVAL;
+		} else if (last) {
+			LOG_ERR("Truncated opcode 0x%02x", *stop);
+			ret = -EINVAL;
+		} else {
+			ret = 0;
+		}
+	}
+	if (ret != 0) {
+		depth = 0;
+	}
+	*used = stop - code;
+
+	/* Never leave keys held behind */
+	kbd_release();
+
+	return ret;
+}
+
+void bc_cancel(void)
+{
+	depth = 0;
+}
+
+int bc_run(const uint8_t *code, size_t len)
+{
+	uint32_t wait_ms;
+	size_t used;
+	int ret;
+
+	do {
+		ret = bc_feed(code, len, true, &used, &wait_ms);
+		code += used;
+		len -= used;
+		k_sleep(K_MSEC(wait_ms));
+	} while (ret == 0 && wait_ms > 0);
+
+	return MIN(ret, 0);
+}
@@ -0,0 +1,101 @@
+/**
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#ifndef REVENGE_BYTECODE_H_
+#define REVENGE_BYTECODE_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Binary payload format.
+ *
+ * A payload starting with BC_MAGIC is a program instead of text. Text never
+ * contains the byte, so both kinds can be sent over the same
+ * characteristic. The program is a sequence of instructions, one opcode
+ * byte followed by its operands. Multi-byte operands are little endian.
+ * Key usages must be below 0x80, a program with others is rejected.
+ *
+ *   END                         stop here
+ *   TYPE    len:u8 text[len]    type ASCII text with the active layout
+ *   KEYS    n:u8 {mods usage}[n] tap pre-translated keys
+ *   COMBO   mods:u8 usage:u8    press a key combination and let go
+ *   RELEASE                     let go of all keys
+ *   DELAY   ms:u16              pause, keys are released first
+ *   MOUSE   buttons:u8 dx:s16 dy:s16
+ *                               move the pointer by an offset
+ *   ROTATE  seconds:u8          move the pointer in circles, in the
+ *                               background while the program goes on
+ *   REPEAT  count:u8 len:u16 body[len]
+ *                               run body count times, nests BC_MAX_DEPTH deep
+ *   LAYOUT  len:u8 name[len]    switch keyboard layout
+ *   PACE    ms:u16              minimum time between HID reports
+ *   PACK    n:u8                new keys per keyboard report, a count
+ *                               the keyboard does not support is ignored
+ *   HOME                        push the pointer into the top left corner
+ *                               and make it the origin
+ *   MOVETO  buttons:u8 x:s16 y:s16
+ *                               move the pointer to a point from the origin
+ *   ARC     buttons:u8 cx:s16 cy:s16 degrees:s16
+ *                               move around a centre relative to the
+ *                               pointer, clockwise for positive degrees
+ *   CURVE   buttons:u8 x1:s16 y1:s16 x2:s16 y2:s16 x:s16 y:s16
+ *                               move along a cubic Bezier curve, points
+ *                               relative to the pointer
+ *
+ * This header is shared with the host-side compiler and must stay free of
+ * Zephyr dependencies.
+ */
+
+#define BC_MAGIC     0xB1
+#define BC_MAX_DEPTH 4
+
+enum bc_op {
+	BC_OP_END     = 0x00,
+	BC_OP_TYPE    = 0x01,
+	BC_OP_KEYS    = 0x02,
+	BC_OP_COMBO   = 0x03,
+	BC_OP_RELEASE = 0x04,
+	BC_OP_DELAY   = 0x05,
+	BC_OP_MOUSE   = 0x06,
+	BC_OP_ROTATE  = 0x07,
+	BC_OP_REPEAT  = 0x08,
+	BC_OP_LAYOUT  = 0x09,
+	BC_OP_PACE    = 0x0A,
+	BC_OP_PACK    = 0x0B,
+	BC_OP_HOME    = 0x0C,
+	BC_OP_MOVETO  = 0x0D,
+	BC_OP_ARC     = 0x0E,
+	BC_OP_CURVE   = 0x0F,
+};
+
+static inline int bc_is_program(const uint8_t *data, size_t len)
+{
+	return len > 0 && data[0] == BC_MAGIC;
+}
+
+/*
+ * Run a program, magic byte excluded. Blocks until it is done, delays
+ * included. Returns 0, -EINVAL for a malformed program or the error of a
+ * failed HID write.
+ */
+int bc_run(const uint8_t *code, size_t len);
+
+/*
+ * Run the complete instructions of a program that arrives in pieces. Unless
+ * last is set, an instruction cut off at the end is left for the next piece
+ * and used tells how many bytes were consumed. Returns 1 once the program
+ * hit END, otherwise like bc_run().
+ *
+ * Never sleeps. A DELAY stops the program and sets wait_ms, after which the
+ * rest from used on, possibly nothing, has to be passed again. Inside a
+ * REPEAT used stays at the outermost REPEAT, which is run on from where it
+ * stopped.
+ */
+int bc_feed(const uint8_t *code, size_t len, bool last, size_t *used, uint32_t *wait_ms);
+
+/* Forget the repeats of a program that is waiting to go on. */
+void bc_cancel(void);
+
+#endif /* REVENGE_BYTECODE_H_ */
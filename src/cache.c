@@ -0,0 +1,354 @@
+/**
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#include <zephyr/kernel.h>
+#include <zephyr/fs/nvs.h>
+#include <zephyr/drivers/flash.h>
+#include <zephyr/storage/flash_map.h>
+#include <zephyr/sys/byteorder.h>
+#include <zephyr/sys/crc.h>
+#include <zephyr/logging/log.h>
+#include <string.h>
+#include <errno.h>
+
+#include <bluetooth/services/nus.h>
+
+#include "cache.h"
+#include "stream.h"
+
+LOG_MODULE_REGISTER(cache);
+
+#if FIXED_PARTITION_EXISTS(cache_partition)
+#define CACHE_PARTITION cache_partition
+#elif defined(CONFIG_SETTINGS) && !DT_HAS_CHOSEN(zephyr_settings_partition)
+#error "storage_partition holds the settings, add a cache_partition for the payload cache"
+#else
+#define CACHE_PARTITION storage_partition
+#endif
+
+#define BLOCK_SIZE  512
+#define SLOT_BLOCKS DIV_ROUND_UP(CONFIG_REVENGE_CACHE_MAX_SIZE, BLOCK_SIZE)
+
+/* NVS ids: the next slot to replace, then each slot's header and blocks */
+#define ID_NEXT      0
+#define SLOT_ID(n)   (1 + (n) * (SLOT_BLOCKS + 1))
+#define BLOCK_ID(n, i) (SLOT_ID(n) + 1 + (i))
+
+BUILD_ASSERT(BLOCK_ID(CONFIG_REVENGE_CACHE_SLOTS, 0) <= UINT16_MAX, "too many cache blocks");
+
+/* Written once all blocks are in, a slot without one is free */
+struct cache_hdr {
+	uint32_t hash;
+	uint32_t len;
+};
+
+static struct nvs_fs fs;
+static bool ready;
+
+/* Playback in progress, one block at a time */
+static struct {
+	bool active;
+	uint8_t slot;
+	uint32_t hash;
+	uint32_t len;
+	/* Bytes read from flash, and how far into the block playback got */
+	uint32_t off;
+	size_t pos;
+	size_t fill;
+	bool first;
+	uint8_t buf[BLOCK_SIZE];
+} play;
+
+static struct {
+	bool active;
+	uint8_t slot;
+	uint32_t hash;
+	uint32_t crc;
+	uint32_t len;
+	uint16_t blocks;
+	size_t fill;
+	uint8_t buf[BLOCK_SIZE];
+} store;
+
+static void reply(uint8_t status, uint32_t hash)
+{
+	uint8_t msg[6] = { CACHE_MAGIC, status };
+
+	sys_put_le32(hash, &msg[2]);
+
+	/* Fails when the sender has not subscribed, nobody to tell then */
+	(void)bt_nus_send(NULL, msg, sizeof(msg));
+}
+
+int cache_init(void)
+{
+	struct flash_pages_info info;
+	int err;
+
+	fs.flash_device = FIXED_PARTITION_DEVICE(CACHE_PARTITION);
+	if (!device_is_ready(fs.flash_device)) {
+		LOG_ERR("Cache flash not ready");
+		return -ENODEV;
+	}
+
+	fs.offset = FIXED_PARTITION_OFFSET(CACHE_PARTITION);
+	err = flash_get_page_info_by_offs(fs.flash_device, fs.offset, &info);
+	if (err) {
+		LOG_ERR("Cannot get cache flash page info (err %d)", err);
+		return err;
+	}
+	fs.sector_size = info.size;
+	fs.sector_count = FIXED_PARTITION_SIZE(CACHE_PARTITION) / info.size;
+
+	err = nvs_mount(&fs);
+	if (err) {
+		LOG_ERR("Failed to mount payload cache (err %d)", err);
+		return err;
+	}
+
+	ready = true;
+
+	return 0;
+}
+
+static int find(uint32_t hash, struct cache_hdr *hdr)
+{
+	for (int slot = 0; slot < CONFIG_REVENGE_CACHE_SLOTS; slot++) {
+		if (nvs_read(&fs, SLOT_ID(slot), hdr, sizeof(*hdr)) == sizeof(*hdr) &&
+		    hdr->hash == hash) {
+			return slot;
+		}
+	}
+
+	return -ENOENT;
+}
+
+int cache_play(uint32_t hash)
+{
+	struct cache_hdr hdr;
+	int slot;
+
+	slot = ready ? find(hash, &hdr) : -ENOENT;
+	if (slot < 0) {
+		LOG_INF("Payload %08x not cached", hash);
+		reply(CACHE_REPLY_MISS, hash);
+		return slot;
+	}
+
+	LOG_INF("Playing cached payload %08x, %u bytes", hash, hdr.len);
+
+	play.active = true;
+	play.slot = slot;
+	play.hash = hash;
+	play.len = hdr.len;
+	play.off = 0;
+	play.pos = 0;
+	play.fill = 0;
+	play.first = true;
+
+	return 0;
+}
+
+int cache_play_step(uint32_t *wait_ms)
+{
+	bool last;
+	size_t used;
+
+	*wait_ms = 0;
+
+	while (play.active && *wait_ms == 0) {
+		if (play.pos == play.fill && play.off < play.len) {
+			size_t n = MIN(play.len - play.off, BLOCK_SIZE);
+
+			if (nvs_read(&fs, BLOCK_ID(play.slot, play.off / BLOCK_SIZE), play.buf, n) !=
+			    (ssize_t)n) {
+				LOG_ERR("Cached payload %08x is damaged", play.hash);
+				n = 0;
+				play.len = play.off;
+			}
+			play.off += n;
+			play.pos = 0;
+			play.fill = n;
+		}
+		last = play.off == play.len;
+
+		/* Blocks go through the same path as streamed chunks */
+		used = stream_feed(&play.buf[play.pos], play.fill - play.pos, play.first, last,
+				   wait_ms);
+		play.pos += used;
+		play.first = false;
+
+		if (last && play.pos == play.fill && *wait_ms == 0) {
+			play.active = false;
+		}
+	}
+
+	return play.active ? 1 : 0;
+}
+
+void cache_play_stop(void)
+{
+	play.active = false;
+}
+
+static int flush_block(void)
+{
+	int ret;
+
+	ret = nvs_write(&fs, BLOCK_ID(store.slot, store.blocks), store.buf, store.fill);
+	if (ret < 0) {
+		LOG_ERR("Failed to write cache block (err %d)", ret);
+		return ret;
+	}
+
+	store.blocks++;
+	store.fill = 0;
+
+	return 0;
+}
+
+int cache_store_begin(uint32_t hash)
+{
+	struct cache_hdr hdr;
+	uint8_t next;
+	int slot;
+
+	if (store.active) {
+		cache_store_end(false);
+	}
+
+	if (!ready) {
+		reply(CACHE_REPLY_FAILED, hash);
+		return -ENODEV;
+	}
+
+	/* Rewrite the payload in place if it is there, else replace the oldest */
+	slot = find(hash, &hdr);
+	if (slot < 0) {
+		if (nvs_read(&fs, ID_NEXT, &next, sizeof(next)) != sizeof(next) ||
+		    next >= CONFIG_REVENGE_CACHE_SLOTS) {
+			next = 0;
+		}
+		slot = next;
+		next = (next + 1) % CONFIG_REVENGE_CACHE_SLOTS;
+		(void)nvs_write(&fs, ID_NEXT, &next, sizeof(next));
+	}
+
+	/* The slot is free until the whole payload is in */
+	(void)nvs_delete(&fs, SLOT_ID(slot));
+
+	store.active = true;
+	store.slot = slot;
+	store.hash = hash;
+	store.crc = 0;
+	store.len = 0;
+	store.blocks = 0;
+	store.fill = 0;
+
+	return 0;
+}
+
+int cache_store_append(const uint8_t *data, size_t len)
+{
+	int err;
+
+	if (!store.active) {
+		return -EINVAL;
+	}
+
+	if (store.len + len > CONFIG_REVENGE_CACHE_MAX_SIZE) {
+		LOG_ERR("Payload %08x larger than %u bytes", store.hash,
+			CONFIG_REVENGE_CACHE_MAX_SIZE);
+		cache_store_end(false);
+		return -EFBIG;
+	}
+
+	store.crc = crc32_ieee_update(store.crc, data, len);
+	store.len += len;
+
+	while (len > 0) {
+		size_t n = MIN(len, BLOCK_SIZE - store.fill);
+
+		memcpy(&store.buf[store.fill], data, n);
+		store.fill += n;
+		data += n;
+		len -= n;
+
+		if (store.fill == BLOCK_SIZE) {
+			err = flush_block();
+			if (err) {
+				cache_store_end(false);
+				return err;
+			}
+		}
+	}
+
+	return 0;
+}
+
+int cache_store_end(bool commit)
+{
+	struct cache_hdr hdr = { .hash = store.hash, .len = store.len };
+	int err = 0;
+
+	if (!store.active) {
+		return -EINVAL;
+	}
+	store.active = false;
+
+	if (!commit) {
+		reply(CACHE_REPLY_FAILED, store.hash);
+		return 0;
+	}
+
+	if (store.fill > 0) {
+		err = flush_block();
+	}
+	if (err == 0 && (store.len == 0 || store.crc != store.hash)) {
+		LOG_ERR("Payload does not match hash %08x", store.hash);
+		err = -EBADMSG;
+	}
+	if (err == 0) {
+		ssize_t ret = nvs_write(&fs, SLOT_ID(store.slot), &hdr, sizeof(hdr));
+
+		err = ret < 0 ? ret : 0;
+	}
+	if (err) {
+		reply(CACHE_REPLY_FAILED, store.hash);
+		return err;
+	}
+
+	/* Free what is left of a longer payload that used the slot before */
+	for (uint16_t i = store.blocks; i < SLOT_BLOCKS; i++) {
+		(void)nvs_delete(&fs, BLOCK_ID(store.slot, i));
+	}
+
+	LOG_INF("Stored payload %08x, %u bytes", store.hash, store.len);
+	reply(CACHE_REPLY_STORED, store.hash);
+
+	return 0;
+}
+
+int cache_run(const uint8_t *cmd, size_t len)
+{
+	uint32_t hash = sys_get_le32(&cmd[2]);
+	int err;
+
+	switch (cmd[1]) {
+	case CACHE_OP_PLAY:
+		err = cache_play(hash);
+		return err == 0 ? 1 : err;
+	case CACHE_OP_STORE:
+		err = cache_store_begin(hash);
+		if (err == 0) {
+			err = cache_store_append(&cmd[CACHE_HDR_SIZE], len - CACHE_HDR_SIZE);
+		}
+		if (err == 0) {
+			err = cache_store_end(true);
+		}
+		return err;
+	default:
+		LOG_ERR("Unknown cache command 0x%02x", cmd[1]);
+		return -EINVAL;
+	}
+}
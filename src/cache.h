@@ -0,0 +1,79 @@
+/**
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#ifndef REVENGE_CACHE_H_
+#define REVENGE_CACHE_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Payload cache in flash.
+ *
+ * Payloads are stored in NVS keyed by their CRC-32 (IEEE), so a payload
+ * that was sent before can be replayed with a six byte command:
+ *
+ *   CACHE_MAGIC CACHE_OP_PLAY  hash:u32le           play a stored payload
+ *   CACHE_MAGIC CACHE_OP_STORE hash:u32le data[]    store data
+ *
+ * A store can be streamed (stream.h) for payloads larger than one write,
+ * the data must hash to the given value. The outcome is notified to the
+ * sender as:
+ *
+ *   CACHE_MAGIC status:u8 hash:u32le
+ *
+ * with status CACHE_REPLY_MISS when asked to play an unknown payload, so it
+ * can be uploaded once, CACHE_REPLY_STORED or CACHE_REPLY_FAILED. Once all
+ * slots are used the oldest stored payload is replaced.
+ *
+ * This header is shared with the host-side compiler and must stay free of
+ * Zephyr dependencies.
+ */
+
+#define CACHE_MAGIC    0xB5
+#define CACHE_HDR_SIZE 6
+
+#define CACHE_OP_PLAY  0x01
+#define CACHE_OP_STORE 0x02
+
+#define CACHE_REPLY_MISS   0x01
+#define CACHE_REPLY_STORED 0x02
+#define CACHE_REPLY_FAILED 0x03
+
+static inline int cache_is_command(const uint8_t *data, size_t len)
+{
+	return len >= CACHE_HDR_SIZE && data[0] == CACHE_MAGIC;
+}
+
+static inline int cache_is_store(const uint8_t *data, size_t len)
+{
+	return cache_is_command(data, len) && data[1] == CACHE_OP_STORE;
+}
+
+int cache_init(void);
+
+/*
+ * Run a command received as a single payload. Returns 1 when it started a
+ * playback, to be run with cache_play_step().
+ */
+int cache_run(const uint8_t *cmd, size_t len);
+
+/* Start playing a stored payload, -ENOENT if there is none with this hash. */
+int cache_play(uint32_t hash);
+
+/*
+ * Play on until the payload is done, returning 0, or until it has to wait,
+ * returning 1 with wait_ms set. Never sleeps.
+ */
+int cache_play_step(uint32_t *wait_ms);
+
+/* Drop the payload being played. */
+void cache_play_stop(void);
+
+/* Store a payload that arrives in pieces, end it with commit false to abort. */
+int cache_store_begin(uint32_t hash);
+int cache_store_append(const uint8_t *data, size_t len);
+int cache_store_end(bool commit);
+
+#endif /* REVENGE_CACHE_H_ */
@@ -0,0 +1,168 @@
+/**
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#include <zephyr/kernel.h>
+#include <zephyr/net_buf.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/bluetooth/conn.h>
+#include <zephyr/bluetooth/l2cap.h>
+#include <string.h>
+#include <errno.h>
+
+#include "coc.h"
+#include "input_ring.h"
+
+LOG_MODULE_REGISTER(coc);
+
+/* Reassembly buffers for SDUs spanning several PDUs */
+NET_BUF_POOL_FIXED_DEFINE(sdu_pool, CONFIG_REVENGE_L2CAP_SDU_BUFS,
+			  BT_L2CAP_SDU_BUF_SIZE(INPUT_PAYLOAD_MAX), 8, NULL);
+
+static struct bt_l2cap_le_chan coc_chan;
+static bool in_use;
+
+/* SDUs that did not fit in the ring, their credits are withheld */
+static K_FIFO_DEFINE(held);
+/*
+ * Held SDU being played in place by the HID side. Once its channel is gone
+ * it is only freed, its credits would go to whichever channel came next.
+ */
+static struct net_buf *playing;
+static bool orphaned;
+static struct k_spinlock playing_lock;
+
+static void (*coc_rx_cb)(void);
+
+static struct net_buf *alloc_buf(struct bt_l2cap_chan *chan)
+{
+	return net_buf_alloc(&sdu_pool, K_NO_WAIT);
+}
+
+static int recv(struct bt_l2cap_chan *chan, struct net_buf *buf)
+{
+	int err = -ENOSPC;
+
+	/* Once one is held the rest queues up behind it to keep the order */
+	if (k_fifo_is_empty(&held)) {
+		err = input_ring_put(buf->data, buf->len);
+	}
+
+	if (err == -ENOSPC) {
+		k_fifo_put(&held, buf);
+		coc_rx_cb();
+		return -EINPROGRESS;
+	}
+	if (err) {
+		LOG_ERR("Dropping SDU of %u bytes (err %d)", buf->len, err);
+	}
+
+	coc_rx_cb();
+
+	return 0;
+}
+
+static void connected(struct bt_l2cap_chan *chan)
+{
+	LOG_INF("Channel connected, tx MTU %u MPS %u, rx MTU %u MPS %u",
+		coc_chan.tx.mtu, coc_chan.tx.mps, coc_chan.rx.mtu, coc_chan.rx.mps);
+}
+
+static void disconnected(struct bt_l2cap_chan *chan)
+{
+	k_spinlock_key_t key;
+	struct net_buf *buf;
+
+	while ((buf = k_fifo_get(&held, K_NO_WAIT)) != NULL) {
+		net_buf_unref(buf);
+	}
+
+	/* Still read by the HID side, which frees it when it is done */
+	key = k_spin_lock(&playing_lock);
+	orphaned = playing != NULL;
+	k_spin_unlock(&playing_lock, key);
+
+	in_use = false;
+	LOG_INF("Channel disconnected");
+}
+
+static const struct bt_l2cap_chan_ops chan_ops = {
+	.alloc_buf = alloc_buf,
+	.recv = recv,
+	.connected = connected,
+	.disconnected = disconnected,
+};
+
+static int accept(struct bt_conn *conn, struct bt_l2cap_server *server,
+		  struct bt_l2cap_chan **chan)
+{
+	if (in_use) {
+		return -ENOMEM;
+	}
+
+	memset(&coc_chan, 0, sizeof(coc_chan));
+	coc_chan.chan.ops = &chan_ops;
+	coc_chan.rx.mtu = INPUT_PAYLOAD_MAX;
+	in_use = true;
+
+	*chan = &coc_chan.chan;
+
+	return 0;
+}
+
+static struct bt_l2cap_server server = {
+	.psm = CONFIG_REVENGE_L2CAP_PSM,
+	.sec_level = BT_SECURITY_L1,
+	.accept = accept,
+};
+
+int coc_init(void (*rx_cb)(void))
+{
+	int err;
+
+	coc_rx_cb = rx_cb;
+
+	err = bt_l2cap_server_register(&server);
+	if (err) {
+		LOG_ERR("Failed to register L2CAP server (err %d)", err);
+	}
+
+	return err;
+}
+
+int coc_peek(const uint8_t **data)
+{
+	k_spinlock_key_t key = k_spin_lock(&playing_lock);
+	int len = 0;
+
+	if (playing == NULL) {
+		playing = k_fifo_get(&held, K_NO_WAIT);
+		orphaned = false;
+	}
+	if (playing != NULL) {
+		*data = playing->data;
+		len = playing->len;
+	}
+	k_spin_unlock(&playing_lock, key);
+
+	return len;
+}
+
+void coc_release(void)
+{
+	k_spinlock_key_t key = k_spin_lock(&playing_lock);
+	struct net_buf *buf = playing;
+	bool gone = orphaned;
+
+	playing = NULL;
+	orphaned = false;
+	k_spin_unlock(&playing_lock, key);
+
+	if (buf == NULL) {
+		return;
+	}
+
+	/* Hands the credits back to the sender, if it is still connected */
+	if (gone || bt_l2cap_chan_recv_complete(&coc_chan.chan, buf) < 0) {
+		net_buf_unref(buf);
+	}
+}
@@ -0,0 +1,35 @@
+/**
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#ifndef REVENGE_COC_H_
+#define REVENGE_COC_H_
+
+#include <stdint.h>
+
+/*
+ * L2CAP connection-oriented channel transport.
+ *
+ * A server on CONFIG_REVENGE_L2CAP_PSM takes payloads as SDUs of up to
+ * INPUT_PAYLOAD_MAX bytes, the same payloads as NUS writes, and queues them
+ * on the input ring. The stack segments SDUs and paces the sender with
+ * L2CAP credits: when the ring is full, SDUs are held and their credits
+ * only returned once the HID side has played them in place.
+ */
+
+/* rx_cb is called from the Bluetooth RX context for every SDU received. */
+int coc_init(void (*rx_cb)(void));
+
+/*
+ * Look at the oldest held SDU in its buffer, in order after everything in
+ * the input ring. Returns its length and sets data, or returns 0 when none
+ * is held. The SDU and its credits are kept until coc_release().
+ */
+int coc_peek(const uint8_t **data);
+
+/*
+ * Give back the SDU that was played, and its credits. One whose channel
+ * was disconnected meanwhile is just freed.
+ */
+void coc_release(void);
+
+#endif /* REVENGE_COC_H_ */
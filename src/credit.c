@@ -0,0 +1,85 @@
+/**
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#include <zephyr/kernel.h>
+#include <zephyr/sys/atomic.h>
+#include <zephyr/sys/byteorder.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/bluetooth/conn.h>
+
+#include <bluetooth/services/nus.h>
+
+#include "credit.h"
+#include "input_ring.h"
+
+LOG_MODULE_REGISTER(credit);
+
+static struct bt_conn *credit_conn;
+static atomic_t enabled;
+/* Granted and not used yet, always covered by free ring space */
+static atomic_t outstanding;
+
+void credit_start(struct bt_conn *conn)
+{
+	credit_conn = conn;
+	atomic_set(&outstanding, 0);
+	atomic_set(&enabled, 1);
+}
+
+void credit_stop(void)
+{
+	atomic_set(&enabled, 0);
+	credit_conn = NULL;
+}
+
+void credit_consume(uint16_t len)
+{
+	atomic_val_t cost = len + INPUT_RING_HDR_SIZE;
+	atomic_val_t old;
+
+	if (!atomic_get(&enabled)) {
+		return;
+	}
+
+	do {
+		old = atomic_get(&outstanding);
+		if (old < cost) {
+			LOG_WRN("Write of %u bytes exceeds the %ld credits granted", len, old);
+		}
+	} while (!atomic_cas(&outstanding, old, MAX(old - cost, 0)));
+}
+
+void credit_update(void)
+{
+	uint8_t msg[3] = { CREDIT_MAGIC };
+	uint32_t space;
+	uint32_t held;
+	uint32_t grant;
+	int err;
+
+	if (!atomic_get(&enabled)) {
+		return;
+	}
+
+	/* Only the consumer grants, so the RX side can only lower this */
+	held = MAX(atomic_get(&outstanding), 0);
+	space = input_ring_space_get();
+	if (space <= held) {
+		return;
+	}
+	grant = MIN(space - held, UINT16_MAX);
+
+	/* Batch small grants unless the sender has nothing left to use */
+	if (grant < CONFIG_REVENGE_CREDIT_GRANT_MIN && held > 0) {
+		return;
+	}
+
+	atomic_add(&outstanding, grant);
+	sys_put_le16(grant, &msg[1]);
+
+	err = bt_nus_send(credit_conn, msg, sizeof(msg));
+	if (err) {
+		LOG_WRN("Failed to grant %u credits (err %d)", grant, err);
+		atomic_sub(&outstanding, grant);
+	}
+}
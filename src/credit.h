@@ -0,0 +1,39 @@
+/**
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#ifndef REVENGE_CREDIT_H_
+#define REVENGE_CREDIT_H_
+
+#include <stdint.h>
+
+struct bt_conn;
+
+/*
+ * Credit-based flow control of NUS writes.
+ *
+ * Once the sender subscribes to NUS TX notifications, the device grants it
+ * room in the input ring as credits:
+ *
+ *   CREDIT_MAGIC credits:u16le
+ *
+ * Credits add up over notifications. A write of n bytes uses n + 2 credits
+ * (the ring framing), so a sender that never writes more than it was
+ * granted never overflows the ring and can keep the link full without
+ * guessing delays. More credits are granted as payloads are taken off the
+ * ring. Senders that do not subscribe are not affected.
+ */
+
+#define CREDIT_MAGIC 0xB3
+
+/* Start granting credits to conn, dropping whatever was granted before. */
+void credit_start(struct bt_conn *conn);
+
+void credit_stop(void);
+
+/* Account for a write received from the sender, from the RX context. */
+void credit_consume(uint16_t len);
+
+/* Grant the ring space freed since the last grant, from the consumer. */
+void credit_update(void);
+
+#endif /* REVENGE_CREDIT_H_ */
@@ -0,0 +1,185 @@
+/**
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#include <zephyr/kernel.h>
+#include <zephyr/sys/atomic.h>
+#include <zephyr/sys/util.h>
+#include <zephyr/usb/class/usb_hid.h>
+#include <zephyr/logging/log.h>
+#include <string.h>
+#include <errno.h>
+
+#include "hid_out.h"
+
+LOG_MODULE_REGISTER(hid_out);
+
+#define EMITTER_STACK_SIZE 1024
+
+#ifdef CONFIG_HID_INTERRUPT_EP_MPS
+BUILD_ASSERT(HID_OUT_REPORT_MAX <= CONFIG_HID_INTERRUPT_EP_MPS,
+	     "reports do not fit the interrupt endpoint");
+#endif
+
+/* A report built ahead of time, waiting for its endpoint */
+struct hid_out_report {
+	uint8_t len;
+	uint8_t data[HID_OUT_REPORT_MAX];
+};
+
+K_MEM_SLAB_DEFINE_STATIC(report_pool, ROUND_UP(sizeof(struct hid_out_report), 4),
+			 CONFIG_REVENGE_HID_OUT_REPORTS, 4);
+
+/* Each as deep as the pool, so a report that got a buffer always fits */
+K_MSGQ_DEFINE(mouse_queue, sizeof(struct hid_out_report *), CONFIG_REVENGE_HID_OUT_REPORTS, 4);
+K_MSGQ_DEFINE(kbd_queue, sizeof(struct hid_out_report *), CONFIG_REVENGE_HID_OUT_REPORTS, 4);
+
+struct hid_out_ep {
+	const struct device *dev;
+	struct k_msgq *queue;
+	/* Given by int_in_ready once the host has collected the last report */
+	struct k_sem done;
+	/* Earliest time the next report may be sent */
+	k_timepoint_t next;
+	/* Reports queued or being sent */
+	atomic_t pending;
+	/* Error to hand to the next writer, e.g. the host stopped collecting */
+	atomic_t error;
+};
+
+static struct hid_out_ep eps[HID_OUT_COUNT] = {
+	[HID_OUT_MOUSE] = { .queue = &mouse_queue },
+	[HID_OUT_KBD] = { .queue = &kbd_queue },
+};
+
+static atomic_t min_interval_us = ATOMIC_INIT(CONFIG_REVENGE_HID_MIN_REPORT_INTERVAL_US);
+
+void hid_out_init(const struct device *mouse_dev, const struct device *kbd_dev)
+{
+	eps[HID_OUT_MOUSE].dev = mouse_dev;
+	eps[HID_OUT_KBD].dev = kbd_dev;
+
+	for (size_t i = 0; i < ARRAY_SIZE(eps); i++) {
+		k_sem_init(&eps[i].done, 1, 1);	/* starts off "available" */
+		eps[i].next = sys_timepoint_calc(K_NO_WAIT);
+	}
+}
+
+static void purge(struct hid_out_ep *ep)
+{
+	struct hid_out_report *report;
+
+	while (k_msgq_get(ep->queue, &report, K_NO_WAIT) == 0) {
+		k_mem_slab_free(&report_pool, report);
+		atomic_dec(&ep->pending);
+	}
+}
+
+/* Only sends reports that are ready, never builds them */
+static void emit(void *p1, void *p2, void *p3)
+{
+	struct hid_out_ep *ep = &eps[POINTER_TO_INT(p1)];
+	struct hid_out_report *report;
+	int ret;
+
+	for (;;) {
+		k_msgq_get(ep->queue, &report, K_FOREVER);
+
+		if (k_sem_take(&ep->done, K_MSEC(CONFIG_REVENGE_HID_WRITE_TIMEOUT_MS)) != 0) {
+			LOG_WRN("Endpoint %d not collected by host", (int)(ep - eps));
+			/* The rest would time out one by one, the writer finds out */
+			atomic_set(&ep->error, -ETIMEDOUT);
+			purge(ep);
+		} else {
+			k_sleep(sys_timepoint_timeout(ep->next));
+
+			ret = hid_int_ep_write(ep->dev, report->data, report->len, NULL);
+			if (ret < 0) {
+				LOG_ERR("Failed to write report on endpoint %d (err %d)",
+					(int)(ep - eps), ret);
+				atomic_set(&ep->error, ret);
+				k_sem_give(&ep->done);
+			} else {
+				ep->next = sys_timepoint_calc(K_USEC(atomic_get(&min_interval_us)));
+			}
+		}
+
+		k_mem_slab_free(&report_pool, report);
+		atomic_dec(&ep->pending);
+	}
+}
+
+K_THREAD_DEFINE(mouse_emitter, EMITTER_STACK_SIZE, emit, INT_TO_POINTER(HID_OUT_MOUSE), NULL,
+		NULL, CONFIG_REVENGE_HID_OUT_PRIORITY, 0, 0);
+K_THREAD_DEFINE(kbd_emitter, EMITTER_STACK_SIZE, emit, INT_TO_POINTER(HID_OUT_KBD), NULL, NULL,
+		CONFIG_REVENGE_HID_OUT_PRIORITY, 0, 0);
+
+int hid_out_write(enum hid_out_iface iface, const uint8_t *report, size_t len)
+{
+	struct hid_out_ep *ep = &eps[iface];
+	struct hid_out_report *out;
+	int ret;
+
+	ret = atomic_set(&ep->error, 0);
+	if (ret < 0) {
+		return ret;
+	}
+
+	if (len > sizeof(out->data)) {
+		return -EINVAL;
+	}
+
+	/* Only waits once the emitters are a whole pool of reports behind */
+	if (k_mem_slab_alloc(&report_pool, (void **)&out,
+			     K_MSEC(CONFIG_REVENGE_HID_WRITE_TIMEOUT_MS)) != 0) {
+		LOG_WRN("No report buffer free");
+		return -ETIMEDOUT;
+	}
+
+	memcpy(out->data, report, len);
+	out->len = len;
+
+	atomic_inc(&ep->pending);
+	(void)k_msgq_put(ep->queue, &out, K_NO_WAIT);
+
+	return 0;
+}
+
+void hid_out_drain(void)
+{
+	for (size_t i = 0; i < ARRAY_SIZE(eps); i++) {
+		while (atomic_get(&eps[i].pending) > 0) {
+			k_sleep(K_MSEC(1));
+		}
+	}
+}
+
+void hid_out_in_ready(const struct device *dev)
+{
+	for (size_t i = 0; i < ARRAY_SIZE(eps); i++) {
+		if (eps[i].dev == dev) {
+			k_sem_give(&eps[i].done);
+			return;
+		}
+	}
+}
+
+void hid_out_reset(void)
+{
+	for (size_t i = 0; i < ARRAY_SIZE(eps); i++) {
+		/* Reports built for the old configuration are not sent */
+		purge(&eps[i]);
+		k_sem_reset(&eps[i].done);
+		k_sem_give(&eps[i].done);
+	}
+}
+
+void hid_out_set_min_interval(uint32_t us)
+{
+	/* Kept clear of the sign bit of atomic_t */
+	atomic_set(&min_interval_us, MIN(us, HID_OUT_MIN_INTERVAL_MAX_US));
+}
+
+uint32_t hid_out_get_min_interval(void)
+{
+	return atomic_get(&min_interval_us);
+}
@@ -0,0 +1,57 @@
+/**
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#ifndef REVENGE_HID_OUT_H_
+#define REVENGE_HID_OUT_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <zephyr/device.h>
+
+/*
+ * Paced report output for the HID interrupt IN endpoints.
+ *
+ * Reports are copied into buffers from a small pool and queued per
+ * endpoint. An emitter thread for each endpoint only hands ready reports to
+ * the endpoint, once the host has collected the previous one on it
+ * (int_in_ready), so at most one report goes out per poll interval and
+ * none are overwritten. Building the next report overlaps with sending the
+ * last one. An optional floor spaces reports further apart for hosts that
+ * drop input at full speed.
+ */
+
+/* Largest report written, the NKRO keyboard report */
+#define HID_OUT_REPORT_MAX 18
+
+enum hid_out_iface {
+	HID_OUT_MOUSE,
+	HID_OUT_KBD,
+	HID_OUT_COUNT,
+};
+
+void hid_out_init(const struct device *mouse_dev, const struct device *kbd_dev);
+
+/*
+ * Queue a report. Only blocks while the pool is empty. Returns the error
+ * of an earlier report on the endpoint that could not be sent, e.g.
+ * -ETIMEDOUT when the host stopped collecting them.
+ */
+int hid_out_write(enum hid_out_iface iface, const uint8_t *report, size_t len);
+
+/* Wait until every queued report has been sent. */
+void hid_out_drain(void);
+
+/* Call from the hid_ops int_in_ready callback. */
+void hid_out_in_ready(const struct device *dev);
+
+/* Mark all endpoints idle, e.g. after a bus reset or reconfiguration. */
+void hid_out_reset(void);
+
+/* Longest floor between reports, what a u16 of milliseconds allows */
+#define HID_OUT_MIN_INTERVAL_MAX_US (UINT16_MAX * 1000U)
+
+/* Set the floor between reports, capped at HID_OUT_MIN_INTERVAL_MAX_US. */
+void hid_out_set_min_interval(uint32_t us);
+uint32_t hid_out_get_min_interval(void);
+
+#endif /* REVENGE_HID_OUT_H_ */
@@ -0,0 +1,120 @@
+/**
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#include <zephyr/kernel.h>
+#include <zephyr/sys/atomic.h>
+#include <zephyr/sys/util.h>
+#include <zephyr/sys/byteorder.h>
+#include <string.h>
+#include <errno.h>
+
+#include "input_ring.h"
+
+#define RING_SIZE CONFIG_REVENGE_INPUT_RING_SIZE
+#define RING_MASK (RING_SIZE - 1)
+#define HDR_SIZE  INPUT_RING_HDR_SIZE
+
+BUILD_ASSERT(IS_POWER_OF_TWO(RING_SIZE), "input ring size must be a power of two");
+
+static uint8_t ring[RING_SIZE];
+
+/* Free-running byte counters, head is only written by the producer and tail
+ * only by the consumer.
+ */
+static atomic_t head;
+static atomic_t tail;
+
+/* Header of the unused end of the ring, the payload starts over at 0 */
+#define WRAP_MARK 0xFFFF
+
+/* Worst case left unused at the end when a payload does not fit there */
+#define WRAP_WASTE (HDR_SIZE + INPUT_PAYLOAD_MAX - 1)
+
+BUILD_ASSERT(RING_SIZE > 2 * (HDR_SIZE + INPUT_PAYLOAD_MAX),
+	     "input ring must hold two payloads");
+
+static uint32_t used_get(void)
+{
+	return (uint32_t)atomic_get(&head) - (uint32_t)atomic_get(&tail);
+}
+
+uint32_t input_ring_space_get(void)
+{
+	uint32_t free = RING_SIZE - used_get();
+
+	/* Left for a wrap, so every byte reported can be pushed */
+	return free > WRAP_WASTE ? free - WRAP_WASTE : 0;
+}
+
+int input_ring_put(const uint8_t *data, uint16_t len)
+{
+	uint32_t pos = (uint32_t)atomic_get(&head);
+	uint32_t off = pos & RING_MASK;
+	uint32_t pad = 0;
+
+	if (len == 0 || len > INPUT_PAYLOAD_MAX) {
+		return -EINVAL;
+	}
+
+	/* Payloads are kept in one piece, so they can be used in place */
+	if (off + HDR_SIZE + len > RING_SIZE) {
+		pad = RING_SIZE - off;
+	}
+
+	if (RING_SIZE - used_get() < pad + HDR_SIZE + len) {
+		return -ENOSPC;
+	}
+
+	if (pad >= HDR_SIZE) {
+		sys_put_le16(WRAP_MARK, &ring[off]);
+	}
+	pos += pad;
+	off = pos & RING_MASK;
+
+	sys_put_le16(len, &ring[off]);
+	memcpy(&ring[off + HDR_SIZE], data, len);
+
+	/* Publish only after the payload is in place */
+	atomic_set(&head, (atomic_val_t)(pos + HDR_SIZE + len));
+
+	return 0;
+}
+
+int input_ring_peek(const uint8_t **data)
+{
+	uint32_t pos = (uint32_t)atomic_get(&tail);
+	uint32_t off;
+	uint16_t len;
+
+	for (;;) {
+		if ((uint32_t)atomic_get(&head) == pos) {
+			return 0;
+		}
+
+		off = pos & RING_MASK;
+		if (RING_SIZE - off >= HDR_SIZE) {
+			len = sys_get_le16(&ring[off]);
+			if (len != WRAP_MARK) {
+				break;
+			}
+		}
+
+		/* Skip the end the producer could not use */
+		pos += RING_SIZE - off;
+		atomic_set(&tail, (atomic_val_t)pos);
+	}
+
+	*data = &ring[off + HDR_SIZE];
+
+	return len;
+}
+
+void input_ring_release(void)
+{
+	const uint8_t *data;
+	int len = input_ring_peek(&data);
+
+	if (len > 0) {
+		atomic_set(&tail, atomic_get(&tail) + HDR_SIZE + len);
+	}
+}
@@ -0,0 +1,46 @@
+/**
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#ifndef REVENGE_INPUT_RING_H_
+#define REVENGE_INPUT_RING_H_
+
+#include <stdint.h>
+
+/*
+ * Lock-free single-producer/single-consumer ring of payloads.
+ *
+ * The Bluetooth RX context is the only producer and the HID work queue the
+ * only consumer. Payloads are stored whole, prefixed with their length, so
+ * the consumer always sees the same boundaries the sender wrote. A payload
+ * is never split at the end of the ring, the consumer plays it in place.
+ */
+
+/* Largest payload the HID side takes in one piece */
+#define INPUT_PAYLOAD_MAX 500
+
+/* Framing stored in front of each payload */
+#define INPUT_RING_HDR_SIZE 2
+
+/*
+ * Push one payload, the only copy made of it. Returns 0, -EINVAL for an
+ * empty or oversized payload or -ENOSPC.
+ */
+int input_ring_put(const uint8_t *data, uint16_t len);
+
+/*
+ * Look at the oldest payload where it is stored. Returns its length and
+ * sets data, or returns 0 when the ring is empty. The payload stays valid
+ * and keeps its space until input_ring_release().
+ */
+int input_ring_peek(const uint8_t **data);
+
+/* Drop the oldest payload once it has been used. */
+void input_ring_release(void);
+
+/*
+ * Bytes that can still be pushed, framing included. Leaves out what may be
+ * lost at the end of the ring, so that much can always be pushed.
+ */
+uint32_t input_ring_space_get(void);
+
+#endif /* REVENGE_INPUT_RING_H_ */
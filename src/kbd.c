@@ -0,0 +1,271 @@
+/**
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#include <zephyr/kernel.h>
+#include <zephyr/sys/util.h>
+#include <zephyr/usb/class/usb_hid.h>
+#include <zephyr/logging/log.h>
+#include <string.h>
+#include <errno.h>
+
+#include "kbd.h"
+#include "hid_out.h"
+#include "keymap.h"
+
+LOG_MODULE_REGISTER(kbd);
+
+#define KBD_BOOT_REPORT_SIZE 8	/* [modifier, reserved, key1, key2, ..., key6] */
+#define KBD_BOOT_SLOTS       6
+
+#ifdef CONFIG_REVENGE_KBD_NKRO
+/* [modifier, reserved, bitmap of usages 0x00-0x7F] */
+#define KBD_NKRO_USAGES      KBD_USAGES
+#define KBD_NKRO_REPORT_SIZE (2 + KBD_NKRO_USAGES / 8)
+#define KBD_MAX_KEYS         16
+
+BUILD_ASSERT(KBD_NKRO_REPORT_SIZE <= HID_OUT_REPORT_MAX,
+	     "NKRO report does not fit the HID output buffers");
+
+/* Same layout as the boot report up to the keys, which are a bitmap */
+const uint8_t kbd_report_desc[] = {
+	HID_USAGE_PAGE(HID_USAGE_GEN_DESKTOP),
+	HID_USAGE(HID_USAGE_GEN_DESKTOP_KEYBOARD),
+	HID_COLLECTION(HID_COLLECTION_APPLICATION),
+		/* Modifiers */
+		HID_USAGE_PAGE(HID_USAGE_GEN_KEYBOARD),
+		HID_USAGE_MIN8(0xE0),
+		HID_USAGE_MAX8(0xE7),
+		HID_LOGICAL_MIN8(0),
+		HID_LOGICAL_MAX8(1),
+		HID_REPORT_SIZE(1),
+		HID_REPORT_COUNT(8),
+		/* Data,Var,Abs */
+		HID_INPUT(0x02),
+		/* Reserved */
+		HID_REPORT_SIZE(8),
+		HID_REPORT_COUNT(1),
+		/* Cnst,Var,Abs */
+		HID_INPUT(0x03),
+		/* LEDs */
+		HID_USAGE_PAGE(HID_USAGE_GEN_LEDS),
+		HID_USAGE_MIN8(1),
+		HID_USAGE_MAX8(5),
+		HID_REPORT_SIZE(1),
+		HID_REPORT_COUNT(5),
+		/* Data,Var,Abs */
+		HID_OUTPUT(0x02),
+		HID_REPORT_SIZE(3),
+		HID_REPORT_COUNT(1),
+		/* Cnst,Var,Abs */
+		HID_OUTPUT(0x03),
+		/* Keys, one bit per usage */
+		HID_USAGE_PAGE(HID_USAGE_GEN_KEYBOARD),
+		HID_USAGE_MIN8(0),
+		HID_USAGE_MAX8(KBD_NKRO_USAGES - 1),
+		HID_LOGICAL_MIN8(0),
+		HID_LOGICAL_MAX8(1),
+		HID_REPORT_SIZE(1),
+		HID_REPORT_COUNT(KBD_NKRO_USAGES),
+		/* Data,Var,Abs */
+		HID_INPUT(0x02),
+	HID_END_COLLECTION,
+};
+#else
+#define KBD_MAX_KEYS         KBD_BOOT_SLOTS
+
+const uint8_t kbd_report_desc[] = HID_KEYBOARD_REPORT_DESC();
+#endif
+
+const size_t kbd_report_desc_size = sizeof(kbd_report_desc);
+
+struct kbd_keys {
+	uint8_t mods;
+	uint8_t count;
+	uint8_t usage[KBD_MAX_KEYS];
+};
+
+/* What the host currently sees pressed */
+static struct kbd_keys held;
+/* Taps collected for the next report */
+static struct kbd_keys batch;
+
+static uint8_t keys_per_report = CONFIG_REVENGE_KBD_KEYS_PER_REPORT;
+
+static struct kbd_stats stats;
+
+/* Set by the host with SET_PROTOCOL, e.g. from a BIOS */
+static bool boot_protocol;
+
+static bool nkro_active(void)
+{
+	return IS_ENABLED(CONFIG_REVENGE_KBD_NKRO) && !boot_protocol;
+}
+
+static uint8_t batch_limit(void)
+{
+	return nkro_active() ? keys_per_report : MIN(keys_per_report, KBD_BOOT_SLOTS);
+}
+
+static bool contains(const struct kbd_keys *keys, uint8_t usage)
+{
+	return memchr(keys->usage, usage, keys->count) != NULL;
+}
+
+static size_t build_report(const struct kbd_keys *keys, uint8_t *report)
+{
+#ifdef CONFIG_REVENGE_KBD_NKRO
+	if (nkro_active()) {
+		memset(report, 0, KBD_NKRO_REPORT_SIZE);
+		report[0] = keys->mods;
+		for (uint8_t i = 0; i < keys->count; i++) {
+			if (keys->usage[i] < KBD_NKRO_USAGES) {
+				report[2 + keys->usage[i] / 8] |= BIT(keys->usage[i] % 8);
+			}
+		}
+		return KBD_NKRO_REPORT_SIZE;
+	}
+#endif
+
+	memset(report, 0, KBD_BOOT_REPORT_SIZE);
+	report[0] = keys->mods;
+	/* Key codes fill the slots from index 2 in typing order */
+	memcpy(&report[2], keys->usage, MIN(keys->count, KBD_BOOT_SLOTS));
+
+	return KBD_BOOT_REPORT_SIZE;
+}
+
+static int send_report(const struct kbd_keys *keys)
+{
+#ifdef CONFIG_REVENGE_KBD_NKRO
+	uint8_t report[KBD_NKRO_REPORT_SIZE];
+#else
+	uint8_t report[KBD_BOOT_REPORT_SIZE];
+#endif
+	size_t len = build_report(keys, report);
+	int ret;
+
+	ret = hid_out_write(HID_OUT_KBD, report, len);
+	if (ret < 0) {
+		LOG_ERR("Failed to write keyboard report (err %d)", ret);
+		return ret;
+	}
+
+	held = *keys;
+	stats.reports++;
+
+	return 0;
+}
+
+static int flush_batch(void)
+{
+	int ret;
+
+	if (batch.count == 0) {
+		return 0;
+	}
+
+	/* Keys still held from the last report are released by this one */
+	ret = send_report(&batch);
+	batch.count = 0;
+
+	return ret;
+}
+
+int kbd_tap(uint8_t mods, uint8_t usage)
+{
+	int ret;
+
+	if (usage >= KBD_USAGES) {
+		return -EINVAL;
+	}
+
+	stats.keys++;
+
+	/* A bitmap report is read in usage order, so in NKRO mode only an
+	 * ascending run can share a report without reordering the text.
+	 */
+	if (batch.count > 0 && (mods != batch.mods || contains(&batch, usage) ||
+				contains(&held, usage) ||
+				(nkro_active() && usage < batch.usage[batch.count - 1]))) {
+		ret = flush_batch();
+		if (ret < 0) {
+			return ret;
+		}
+	}
+
+	if (batch.count == 0) {
+		/* The host only sees a new press if the key was released in
+		 * between, and modifiers must settle before the next key goes
+		 * down.
+		 */
+		if (held.count > 0 && (mods != held.mods || contains(&held, usage))) {
+			struct kbd_keys release = { .mods = mods };
+
+			ret = send_report(&release);
+			if (ret < 0) {
+				return ret;
+			}
+		}
+		batch.mods = mods;
+	}
+
+	batch.usage[batch.count++] = usage;
+	if (batch.count >= batch_limit()) {
+		return flush_batch();
+	}
+
+	return 0;
+}
+
+int kbd_type(uint16_t key)
+{
+	int ret;
+
+	ret = kbd_tap(KEYMAP_MODS(key), KEYMAP_USAGE(key));
+	if (ret == 0 && KEYMAP_IS_DEAD(key)) {
+		ret = kbd_type(keymap_lookup(' '));
+	}
+
+	return ret;
+}
+
+int kbd_release(void)
+{
+	static const struct kbd_keys none;
+	int ret;
+
+	ret = flush_batch();
+	if (ret < 0) {
+		return ret;
+	}
+
+	if (held.count == 0 && held.mods == 0) {
+		return 0;
+	}
+
+	return send_report(&none);
+}
+
+int kbd_set_keys_per_report(uint8_t count)
+{
+	if (count < 1 || count > KBD_MAX_KEYS) {
+		return -EINVAL;
+	}
+
+	keys_per_report = count;
+
+	return 0;
+}
+
+void kbd_set_boot_protocol(bool boot)
+{
+	boot_protocol = boot;
+}
+
+void kbd_stats_get(struct kbd_stats *out, bool reset)
+{
+	*out = stats;
+	if (reset) {
+		memset(&stats, 0, sizeof(stats));
+	}
+}
@@ -0,0 +1,65 @@
+/**
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#ifndef REVENGE_KBD_H_
+#define REVENGE_KBD_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Keyboard report stream.
+ *
+ * Keys are tapped through this layer rather than written as press/release
+ * pairs. It keeps the last key and modifiers held and only inserts a
+ * release when the next key is the same usage or needs other modifiers, so
+ * "HELLO" goes out as seven reports (five presses, the release between the
+ * two Ls and the final one) with shift held throughout instead of ten with
+ * shift dropped and re-asserted.
+ *
+ * Runs of distinct keys with the same modifiers can also be packed into the
+ * six slots of the boot report, several new keys per report in typing
+ * order. This relies on the host handling the slots of a report in order,
+ * which Linux does, so it is off (one key per report) unless configured.
+ *
+ * With CONFIG_REVENGE_KBD_NKRO the interface reports a bitmap of every key
+ * instead, lifting the six key limit, and falls back to boot reports when
+ * the host selects the boot protocol.
+ *
+ * Anything held must be released with kbd_release() before the stream
+ * pauses (delays, other output), or the host will start auto-repeating.
+ */
+
+/* Report descriptor matching the reports built here */
+extern const uint8_t kbd_report_desc[];
+extern const size_t kbd_report_desc_size;
+
+/* Keys are usages 0x00-0x7F, the range both reports can carry */
+#define KBD_USAGES 128
+
+/* Returns 0, -EINVAL for a usage outside KBD_USAGES or a write error. */
+int kbd_tap(uint8_t mods, uint8_t usage);
+
+/* Tap a keymap entry, following dead keys with a space. */
+int kbd_type(uint16_t key);
+
+int kbd_release(void);
+
+/*
+ * Number of new keys per report, 1 to 6 (16 with NKRO). Returns 0 or
+ * -EINVAL.
+ */
+int kbd_set_keys_per_report(uint8_t count);
+
+/* Call from the hid_ops protocol_change callback. */
+void kbd_set_boot_protocol(bool boot);
+
+struct kbd_stats {
+	uint32_t keys;
+	uint32_t reports;
+};
+
+void kbd_stats_get(struct kbd_stats *out, bool reset);
+
+#endif /* REVENGE_KBD_H_ */
@@ -0,0 +1,32 @@
+/**
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#include <string.h>
+#include <errno.h>
+
+#include "keymap.h"
+
+int keymap_select(const char *name, size_t len)
+{
+	for (size_t i = 0; i < keymap_layout_count; i++) {
+		const char *candidate = keymap_layouts[i].name;
+
+		if (strlen(candidate) == len && memcmp(candidate, name, len) == 0) {
+			keymap_active = keymap_layouts[i].map;
+			return 0;
+		}
+	}
+
+	return -ENOENT;
+}
+
+const char *keymap_active_name(void)
+{
+	for (size_t i = 0; i < keymap_layout_count; i++) {
+		if (keymap_layouts[i].map == keymap_active) {
+			return keymap_layouts[i].name;
+		}
+	}
+
+	return "";
+}
@@ -0,0 +1,52 @@
+/**
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#ifndef REVENGE_KEYMAP_H_
+#define REVENGE_KEYMAP_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * ASCII to HID translation.
+ *
+ * Each entry packs the usage ID in the low seven bits, a dead-key flag in
+ * bit 7 and the modifier bits of the boot keyboard report in the high byte,
+ * so translating a character is a single load whatever layout is active. A
+ * zero entry means the character cannot be typed.
+ *
+ * The tables are generated at build time from layouts/ by
+ * scripts/gen_keymap.py.
+ */
+
+#define KEYMAP_SIZE 128
+
+#define KEYMAP_DEAD 0x80
+
+#define KEYMAP_ENTRY(usage, mods) ((uint16_t)(((mods) << 8) | (usage)))
+#define KEYMAP_USAGE(entry)       ((uint8_t)((entry) & 0x7F))
+#define KEYMAP_MODS(entry)        ((uint8_t)((entry) >> 8))
+/* Dead keys must be followed by a space to produce the bare character */
+#define KEYMAP_IS_DEAD(entry)     (((entry) & KEYMAP_DEAD) != 0)
+
+struct keymap_layout {
+	const char *name;
+	const uint16_t *map;
+};
+
+extern const struct keymap_layout keymap_layouts[];
+extern const size_t keymap_layout_count;
+
+extern const uint16_t *keymap_active;
+
+static inline uint16_t keymap_lookup(uint8_t ascii)
+{
+	return ascii < KEYMAP_SIZE ? keymap_active[ascii] : 0;
+}
+
+/* Switch to a compiled-in layout. Returns 0 or -ENOENT. */
+int keymap_select(const char *name, size_t len);
+
+const char *keymap_active_name(void);
+
+#endif /* REVENGE_KEYMAP_H_ */
@@ -0,0 +1,209 @@
+/**
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#include <zephyr/kernel.h>
+#include <zephyr/sys/atomic.h>
+#include <zephyr/sys/byteorder.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/bluetooth/conn.h>
+#include <zephyr/bluetooth/gatt.h>
+
+#include <bluetooth/services/nus.h>
+
+#include "link.h"
+
+LOG_MODULE_REGISTER(link);
+
+/* 7.5 to 15 ms while data flows */
+#define FAST_PARAM BT_LE_CONN_PARAM(6, 12, 0, 400)
+/* 100 to 200 ms, skipping up to 4 events, when idle */
+#define IDLE_PARAM BT_LE_CONN_PARAM(80, 160, 4, 600)
+
+static struct bt_conn *link_conn;
+
+/* Wanted interval, set whether or not the central has agreed yet */
+static atomic_t fast;
+
+static struct {
+	uint16_t mtu;
+	uint8_t tx_phy;
+	uint8_t rx_phy;
+	uint16_t tx_len;
+	uint16_t rx_len;
+	uint16_t interval;
+	uint16_t latency;
+	uint16_t timeout;
+} params;
+
+static void report_handler(struct k_work *work);
+static void param_handler(struct k_work *work);
+static void idle_handler(struct k_work *work);
+
+static K_WORK_DEFINE(report_work, report_handler);
+static K_WORK_DEFINE(param_work, param_handler);
+static K_WORK_DELAYABLE_DEFINE(idle_work, idle_handler);
+
+static void report_handler(struct k_work *work)
+{
+	uint8_t msg[15] = { LINK_MAGIC };
+	struct bt_conn *conn = link_conn;
+	int err;
+
+	if (conn == NULL) {
+		return;
+	}
+
+	LOG_INF("MTU %u, PHY tx %u rx %u, data length tx %u rx %u, "
+		"interval %u us, latency %u, timeout %u ms",
+		params.mtu, params.tx_phy, params.rx_phy, params.tx_len, params.rx_len,
+		params.interval * 1250, params.latency, params.timeout * 10);
+
+	sys_put_le16(params.mtu, &msg[1]);
+	msg[3] = params.tx_phy;
+	msg[4] = params.rx_phy;
+	sys_put_le16(params.tx_len, &msg[5]);
+	sys_put_le16(params.rx_len, &msg[7]);
+	sys_put_le16(params.interval, &msg[9]);
+	sys_put_le16(params.latency, &msg[11]);
+	sys_put_le16(params.timeout, &msg[13]);
+
+	/* Fails when the sender has not subscribed, which is fine */
+	err = bt_nus_send(conn, msg, sizeof(msg));
+	if (err) {
+		LOG_DBG("Link parameters not reported (err %d)", err);
+	}
+}
+
+static void param_handler(struct k_work *work)
+{
+	struct bt_conn *conn = link_conn;
+	int err;
+
+	if (conn == NULL) {
+		return;
+	}
+
+	err = bt_conn_le_param_update(conn, atomic_get(&fast) ? FAST_PARAM : IDLE_PARAM);
+	if (err && err != -EALREADY) {
+		LOG_WRN("Connection parameter update failed (err %d)", err);
+	}
+}
+
+static void idle_handler(struct k_work *work)
+{
+	if (atomic_cas(&fast, 1, 0)) {
+		k_work_submit(&param_work);
+	}
+}
+
+static void mtu_exchanged(struct bt_conn *conn, uint8_t err,
+			  struct bt_gatt_exchange_params *exchange)
+{
+	if (err) {
+		LOG_WRN("MTU exchange failed (err %u)", err);
+	}
+}
+
+static struct bt_gatt_exchange_params exchange_params = {
+	.func = mtu_exchanged,
+};
+
+void link_start(struct bt_conn *conn)
+{
+	struct bt_conn_info info;
+	int err;
+
+	link_conn = conn;
+
+	if (bt_conn_get_info(conn, &info) == 0) {
+		params.tx_phy = info.le.phy->tx_phy;
+		params.rx_phy = info.le.phy->rx_phy;
+		params.tx_len = info.le.data_len->tx_max_len;
+		params.rx_len = info.le.data_len->rx_max_len;
+		params.interval = info.le.interval;
+		params.latency = info.le.latency;
+		params.timeout = info.le.timeout;
+	}
+	params.mtu = bt_gatt_get_mtu(conn);
+
+	err = bt_gatt_exchange_mtu(conn, &exchange_params);
+	if (err && err != -EALREADY) {
+		LOG_WRN("MTU exchange not started (err %d)", err);
+	}
+
+	err = bt_conn_le_data_len_update(conn, BT_LE_DATA_LEN_PARAM_MAX);
+	if (err) {
+		LOG_WRN("Data length update failed (err %d)", err);
+	}
+
+	err = bt_conn_le_phy_update(conn, BT_CONN_LE_PHY_PARAM_2M);
+	if (err) {
+		LOG_WRN("PHY update failed (err %d)", err);
+	}
+
+	atomic_set(&fast, 1);
+	k_work_submit(&param_work);
+	k_work_reschedule(&idle_work, K_MSEC(CONFIG_REVENGE_LINK_IDLE_TIMEOUT_MS));
+}
+
+void link_stop(void)
+{
+	link_conn = NULL;
+	k_work_cancel_delayable(&idle_work);
+}
+
+void link_activity(void)
+{
+	if (link_conn == NULL) {
+		return;
+	}
+
+	if (atomic_cas(&fast, 0, 1)) {
+		k_work_submit(&param_work);
+	}
+	k_work_reschedule(&idle_work, K_MSEC(CONFIG_REVENGE_LINK_IDLE_TIMEOUT_MS));
+}
+
+static void le_param_updated(struct bt_conn *conn, uint16_t interval, uint16_t latency,
+			     uint16_t timeout)
+{
+	params.interval = interval;
+	params.latency = latency;
+	params.timeout = timeout;
+	k_work_submit(&report_work);
+}
+
+static void le_phy_updated(struct bt_conn *conn, struct bt_conn_le_phy_info *phy)
+{
+	params.tx_phy = phy->tx_phy;
+	params.rx_phy = phy->rx_phy;
+	k_work_submit(&report_work);
+}
+
+static void le_data_len_updated(struct bt_conn *conn, struct bt_conn_le_data_len_info *info)
+{
+	params.tx_len = info->tx_max_len;
+	params.rx_len = info->rx_max_len;
+	k_work_submit(&report_work);
+}
+
+BT_CONN_CB_DEFINE(link_callbacks) = {
+	.le_param_updated = le_param_updated,
+	.le_phy_updated = le_phy_updated,
+	.le_data_len_updated = le_data_len_updated,
+};
+
+static void att_mtu_updated(struct bt_conn *conn, uint16_t tx, uint16_t rx)
+{
+	params.mtu = MIN(tx, rx);
+	k_work_submit(&report_work);
+}
+
+static struct bt_gatt_cb gatt_callbacks = {
+	.att_mtu_updated = att_mtu_updated,
+};
+
+void link_init(void)
+{
+	bt_gatt_cb_register(&gatt_callbacks);
+}
@@ -0,0 +1,38 @@
+/**
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#ifndef REVENGE_LINK_H_
+#define REVENGE_LINK_H_
+
+#include <stdint.h>
+
+struct bt_conn;
+
+/*
+ * Link parameter negotiation.
+ *
+ * On connection the device asks for the largest ATT MTU and data length,
+ * the 2M PHY and a short connection interval, then falls back to a relaxed
+ * interval once no data has been received for a while. Whenever the
+ * negotiated parameters change they are logged and, if the sender has
+ * subscribed to NUS TX notifications, reported back as:
+ *
+ *   LINK_MAGIC mtu:u16 tx_phy:u8 rx_phy:u8 tx_len:u16 rx_len:u16
+ *              interval:u16 latency:u16 timeout:u16
+ *
+ * Multi-byte fields are little endian, PHYs are BT_GAP_LE_PHY_* values, the
+ * interval is in 1.25 ms units and the timeout in 10 ms units.
+ */
+
+#define LINK_MAGIC 0xB4
+
+void link_init(void);
+
+void link_start(struct bt_conn *conn);
+
+void link_stop(void);
+
+/* Call for every write received, switches back to the fast interval. */
+void link_activity(void);
+
+#endif /* REVENGE_LINK_H_ */
@@ -0,0 +1,117 @@
+/**
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#include <string.h>
+#include <errno.h>
+
+#include "lz.h"
+
+#define WINDOW_MASK (LZ_WINDOW_SIZE - 1)
+
+_Static_assert((LZ_WINDOW_SIZE & WINDOW_MASK) == 0, "window size must be a power of two");
+
+void lz_init(struct lz_dec *dec)
+{
+	memset(dec, 0, sizeof(*dec));
+}
+
+/* Pass on what was decoded, false while out still holds some of it back */
+static bool flush(struct lz_dec *dec, bool last, lz_out_t out, void *ctx)
+{
+	uint32_t start = dec->emitted & WINDOW_MASK;
+	uint32_t len = dec->produced - dec->emitted;
+
+	/* Runs never wrap, output is flushed whenever the window does */
+	if (len > 0 || last) {
+		dec->emitted += out(&dec->window[start], len, last, ctx);
+	}
+
+	return dec->emitted == dec->produced;
+}
+
+static bool put(struct lz_dec *dec, uint8_t byte, lz_out_t out, void *ctx)
+{
+	dec->window[dec->produced & WINDOW_MASK] = byte;
+	dec->produced++;
+
+	if ((dec->produced & WINDOW_MASK) == 0) {
+		return flush(dec, false, out, ctx);
+	}
+
+	return true;
+}
+
+/* Go on with a match, false once the window is full of held back output */
+static bool copy(struct lz_dec *dec, lz_out_t out, void *ctx)
+{
+	bool more = true;
+
+	while (more && dec->copy_left > 0) {
+		dec->copy_left--;
+		more = put(dec, dec->window[(dec->produced - dec->copy_offset) & WINDOW_MASK],
+			   out, ctx);
+	}
+
+	return more;
+}
+
+int lz_feed(struct lz_dec *dec, const uint8_t *in, size_t len, bool last, lz_out_t out,
+	    void *ctx, size_t *used)
+{
+	const uint8_t *start = in;
+	const uint8_t *end = in + len;
+	bool more;
+
+	/* Whatever out held back the last time comes first */
+	more = !dec->error && flush(dec, false, out, ctx) && copy(dec, out, ctx);
+
+	while (more && in < end) {
+		uint8_t lo;
+
+		if (dec->items == 0) {
+			dec->flags = *in++;
+			dec->items = 8;
+			continue;
+		}
+
+		if (!(dec->flags & 1)) {
+			more = put(dec, *in++, out, ctx);
+		} else {
+			if (!dec->split) {
+				lo = *in++;
+				if (in == end) {
+					dec->match_lo = lo;
+					dec->split = true;
+					break;
+				}
+			} else {
+				lo = dec->match_lo;
+				dec->split = false;
+			}
+
+			dec->copy_offset = (((*in & 0x03) << 8) | lo) + 1;
+			dec->copy_left = (*in++ >> 2) + LZ_MIN_MATCH;
+			if (dec->copy_offset > dec->produced) {
+				dec->error = true;
+				break;
+			}
+
+			more = copy(dec, out, ctx);
+		}
+
+		dec->flags >>= 1;
+		dec->items--;
+	}
+
+	*used = in - start;
+
+	if (dec->error) {
+		return -EINVAL;
+	}
+
+	if (more && in == end) {
+		flush(dec, last, out, ctx);
+	}
+
+	return 0;
+}
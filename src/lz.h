@@ -0,0 +1,77 @@
+/**
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#ifndef REVENGE_LZ_H_
+#define REVENGE_LZ_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * LZSS compressed payloads.
+ *
+ * A payload starting with LZ_MAGIC is the compressed form of another
+ * payload (text, program or cache store). The data is a series of groups,
+ * each a flag byte followed by up to eight items, bit 0 of the flag byte
+ * describing the first one:
+ *
+ *   0  literal   one byte copied to the output
+ *   1  match     b0 b1, copies len = (b1 >> 2) + LZ_MIN_MATCH bytes
+ *                starting offset = ((b1 & 3) << 8 | b0) + 1 bytes back
+ *
+ * Matches reach back at most LZ_WINDOW_SIZE bytes, so the decoder only
+ * keeps that much output and never the whole payload. Decoding is
+ * streamed, input can be fed in pieces of any size.
+ *
+ * This header is shared with the host-side compiler and must stay free of
+ * Zephyr dependencies.
+ */
+
+#define LZ_MAGIC       0xB6
+#define LZ_WINDOW_SIZE 1024
+#define LZ_MIN_MATCH   3
+#define LZ_MAX_MATCH   (LZ_MIN_MATCH + 63)
+
+static inline int lz_is_compressed(const uint8_t *data, size_t len)
+{
+	return len > 0 && data[0] == LZ_MAGIC;
+}
+
+/*
+ * Receives the output in order, last is set on the final call. Returns how
+ * much of it was taken, the rest is passed again by the next lz_feed().
+ */
+typedef size_t (*lz_out_t)(const uint8_t *data, size_t len, bool last, void *ctx);
+
+struct lz_dec {
+	uint8_t window[LZ_WINDOW_SIZE];
+	/* Bytes decoded and bytes passed on, window holds the tail */
+	uint32_t produced;
+	uint32_t emitted;
+	uint8_t flags;
+	/* Items left in the current group */
+	uint8_t items;
+	/* First byte of a match split between two pieces */
+	uint8_t match_lo;
+	/* Rest of a match cut short by held back output */
+	uint8_t copy_left;
+	uint16_t copy_offset;
+	bool split;
+	bool error;
+};
+
+void lz_init(struct lz_dec *dec);
+
+/*
+ * Decode a piece of compressed data, magic byte excluded. Output is passed
+ * to out in runs of up to LZ_WINDOW_SIZE bytes before the window wraps.
+ * Once out holds some back, decoding stops and used tells how much input
+ * was consumed, the rest has to be passed again later. Returns 0, or
+ * -EINVAL once the data turned out to be corrupt, after which nothing more
+ * is decoded.
+ */
+int lz_feed(struct lz_dec *dec, const uint8_t *in, size_t len, bool last, lz_out_t out,
+	    void *ctx, size_t *used);
+
+#endif /* REVENGE_LZ_H_ */
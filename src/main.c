@@ -18,27 +18,41 @@
 #include <zephyr/bluetooth/uuid.h>
 #include <zephyr/bluetooth/gatt.h>
 #include <zephyr/bluetooth/hci.h>
-#include <math.h>
+#include <zephyr/settings/settings.h>
 
 #include <bluetooth/services/nus.h>
 
+#include "input_ring.h"
+#include "credit.h"
+#include "link.h"
+#include "coc.h"
+#include "cache.h"
+#include "boot.h"
+#include "hid_out.h"
+#include "kbd.h"
+#include "mouse.h"
+#include "stream.h"
+
 #define LOG_LEVEL LOG_LEVEL_DBG
 LOG_MODULE_REGISTER(main);
 
-#ifndef M_PI
-#define M_PI 3.14159265358979323846
-#endif
-
 #define DEVICE_NAME CONFIG_BT_DEVICE_NAME
 #define DEVICE_NAME_LEN	(sizeof(DEVICE_NAME) - 1)
 
-#define UART_BUF_SIZE 500
+#define UART_BUF_SIZE INPUT_PAYLOAD_MAX
+
+/* A single byte payload that stops whatever is playing or queued */
+#define CANCEL_MAGIC 0xB7
 
 static struct bt_conn *current_conn;
 
 K_THREAD_STACK_DEFINE(my_stack_area, 1024 * 4);
 struct k_work_q my_work_q;
 
+/* The mouse endpoint is fed separately, so circles go on while typing */
+K_THREAD_STACK_DEFINE(mouse_stack_area, 1024 * 2);
+struct k_work_q mouse_work_q;
+
 
 
 static const struct bt_data ad[] = {
@@ -50,10 +64,62 @@ static const struct bt_data sd[] = {
 	BT_DATA_BYTES(BT_DATA_UUID128_ALL, BT_UUID_NUS_VAL),
 };
 
+/*
+ * Set when advertising has to start again, which it can only once the
+ * connection object is freed.
+ */
+enum readvertise {
+	READVERTISE_NONE,
+	/* To the bonded peer first, after a disconnect */
+	READVERTISE_DIRECTED,
+	/* To anyone, after the bonded peer did not come back in time */
+	READVERTISE_UNDIRECTED,
+};
+
+static atomic_t readvertise;
+
+static void bond_found(const struct bt_bond_info *info, void *user_data)
+{
+	bt_addr_le_copy(user_data, &info->addr);
+}
+
+/* Directed advertising to the bonded peer if any, undirected after that */
+static void advertise(bool directed)
+{
+	bt_addr_le_t peer = *BT_ADDR_LE_ANY;
+	int err;
+
+	if (directed) {
+		bt_foreach_bond(BT_ID_DEFAULT, bond_found, &peer);
+	}
+
+	if (!bt_addr_le_eq(&peer, BT_ADDR_LE_ANY)) {
+		char addr[BT_ADDR_LE_STR_LEN];
+
+		bt_addr_le_to_str(&peer, addr, sizeof(addr));
+		LOG_INF("Directed advertising to %s", addr);
+		err = bt_le_adv_start(BT_LE_ADV_CONN_DIR(&peer), NULL, 0, NULL, 0);
+	} else {
+		err = bt_le_adv_start(BT_LE_ADV_CONN, ad, ARRAY_SIZE(ad), sd, ARRAY_SIZE(sd));
+	}
+
+	if (err) {
+		LOG_ERR("Advertising failed to start (err %d)", err);
+	}
+}
+
 static void connected(struct bt_conn *conn, uint8_t err)
 {
 	char addr[BT_ADDR_LE_STR_LEN];
 
+	if (err == BT_HCI_ERR_ADV_TIMEOUT) {
+		/* The bonded peer did not come back in time, let anyone connect
+		 * once the connection object of the attempt is freed.
+		 */
+		atomic_set(&readvertise, READVERTISE_UNDIRECTED);
+		return;
+	}
+
 	if (err) {
 		LOG_ERR("Connection failed, err 0x%02x %s", err, bt_hci_err_to_str(err));
 		return;
@@ -63,6 +129,14 @@ static void connected(struct bt_conn *conn, uint8_t err)
 	LOG_INF("Connected %s", addr);
 
 	current_conn = bt_conn_ref(conn);
+
+	link_start(current_conn);
+
+	/* Pairs on the first connection, so the bond outlives a reboot */
+	err = bt_conn_set_security(conn, BT_SECURITY_L2);
+	if (err) {
+		LOG_WRN("Failed to request security (err %d)", err);
+	}
 }
 
 static void disconnected(struct bt_conn *conn, uint8_t reason)
@@ -73,349 +147,395 @@ static void disconnected(struct bt_conn *conn, uint8_t reason)
 
 	LOG_INF("Disconnected: %s, reason 0x%02x %s", addr, reason, bt_hci_err_to_str(reason));
 
+	credit_stop();
+	link_stop();
+
 	if (current_conn) {
 		bt_conn_unref(current_conn);
 		current_conn = NULL;
 	}
 
-	bt_le_adv_start(BT_LE_ADV_CONN, ad, ARRAY_SIZE(ad), sd, ARRAY_SIZE(sd));
+	atomic_set(&readvertise, READVERTISE_DIRECTED);
+}
+
+/* Only once the connection object is free can advertising start again */
+static void recycled(void)
+{
+	/* Also called for the object of a timed out directed advertiser */
+	switch (atomic_set(&readvertise, READVERTISE_NONE)) {
+	case READVERTISE_DIRECTED:
+		advertise(true);
+		break;
+	case READVERTISE_UNDIRECTED:
+		advertise(false);
+		break;
+	default:
+		break;
+	}
+}
+
+static void security_changed(struct bt_conn *conn, bt_security_t level,
+			     enum bt_security_err err)
+{
+	if (err) {
+		LOG_WRN("Security failed, level %u err %d", level, err);
+	} else {
+		LOG_INF("Security level %u", level);
+	}
 }
 
 BT_CONN_CB_DEFINE(conn_callbacks) = {
 	.connected    = connected,
 	.disconnected = disconnected,
+	.recycled     = recycled,
+	.security_changed = security_changed,
 };
 
-static void write_hid(const char *data, size_t size);
+struct k_work_delayable play_work;
 
-static char keys_buffer[UART_BUF_SIZE];
-static uint16_t keys_len;
-struct k_work send_keys_work;
+/* Payload being played, kept until everything in it has run */
+enum play_source {
+	PLAY_NONE,
+	PLAY_PAYLOAD,
+	PLAY_CACHE,
+};
 
-static void send_keys(struct k_work *work)
+static struct {
+	enum play_source source;
+	/* Played in place, in the ring or in the buffer the channel holds */
+	const uint8_t *data;
+	bool held;
+	size_t len;
+	size_t pos;
+	bool first;
+	bool last;
+} player;
+
+static inline bool is_cancel(const uint8_t *data, size_t len)
 {
-	write_hid(keys_buffer, keys_len);
+	return len == 1 && data[0] == CANCEL_MAGIC;
 }
 
+/* Set by a cancel payload, handled ahead of everything queued */
+static atomic_t cancel_pending;
 
-static void bt_receive_cb(struct bt_conn *conn, const uint8_t *const data,
-			  uint16_t len)
+/* Payloads from the ring first, then those the L2CAP channel held back */
+static int next_payload(void)
 {
-	memcpy(keys_buffer, data, len);
-	keys_len = len;
-	k_work_submit_to_queue(&my_work_q, &send_keys_work);
-}
-
-static struct bt_nus_cb nus_cb = {
-	.received = bt_receive_cb,
-};
+	int len = input_ring_peek(&player.data);
 
+	player.held = false;
+#ifdef CONFIG_REVENGE_L2CAP
+	if (len == 0) {
+		len = coc_peek(&player.data);
+		player.held = len > 0;
+	}
+#endif
 
-/* HID */
-
-static const uint8_t hid_mouse_report_desc[] = HID_MOUSE_REPORT_DESC(2);
-static const uint8_t hid_kbd_report_desc[] = HID_KEYBOARD_REPORT_DESC();
+	return len;
+}
 
-static K_SEM_DEFINE(usb_sem, 1, 1);	/* starts off "available" */
+/* Hand the payload's space back once nothing points into it */
+static void release_payload(void)
+{
+	if (player.data == NULL) {
+		return;
+	}
 
-#define MOUSE_BTN_REPORT_POS	0
-#define MOUSE_X_REPORT_POS	1
-#define MOUSE_Y_REPORT_POS	2
+#ifdef CONFIG_REVENGE_L2CAP
+	if (player.held) {
+		coc_release();
+	} else
+#endif
+	{
+		input_ring_release();
+	}
+	player.data = NULL;
+}
 
-#define MOUSE_BTN_LEFT		BIT(0)
-#define MOUSE_BTN_RIGHT		BIT(1)
-#define MOUSE_BTN_MIDDLE	BIT(2)
+/* Payloads wait in the ring until the host has configured the device */
+static atomic_t usb_configured;
 
-static void in_ready_cb(const struct device *dev)
+static void stop_all(void)
 {
-	ARG_UNUSED(dev);
-	k_sem_give(&usb_sem);
+	player.source = PLAY_NONE;
+	release_payload();
+#ifdef CONFIG_REVENGE_CACHE
+	cache_play_stop();
+#endif
+	stream_cancel();
+	mouse_stop();
+	kbd_release();
 }
 
-static const struct hid_ops ops = {
-	.int_in_ready = in_ready_cb,
-};
+/* Stop what is playing and drop everything queued up to the cancel */
+static void cancel(void)
+{
+	const uint8_t *data;
+	bool found = false;
+	int len;
+
+	LOG_INF("Cancelled");
+	stop_all();
+
+	while (!found && (len = input_ring_peek(&data)) != 0) {
+		found = is_cancel(data, len);
+		input_ring_release();
+	}
+}
 
-static int ascii_to_hid(uint8_t ascii)
+/* Take the next payload and set it up for playing, false if there is none */
+static bool load_payload(void)
 {
-	if (ascii < 32) {
-		/* Character not supported */
-		return -1;
-	} else if (ascii < 48) {
-		/* Special characters */
-		switch (ascii) {
-		case 32:
-			return HID_KEY_SPACE;
-		case 33:
-			return HID_KEY_1;
-		case 34:
-			return HID_KEY_APOSTROPHE;
-		case 35:
-			return HID_KEY_3;
-		case 36:
-			return HID_KEY_4;
-		case 37:
-			return HID_KEY_5;
-		case 38:
-			return HID_KEY_7;
-		case 39:
-			return HID_KEY_APOSTROPHE;
-		case 40:
-			return HID_KEY_9;
-		case 41:
-			return HID_KEY_0;
-		case 42:
-			return HID_KEY_8;
-		case 43:
-			return HID_KEY_EQUAL;
-		case 44:
-			return HID_KEY_COMMA;
-		case 45:
-			return HID_KEY_MINUS;
-		case 46:
-			return HID_KEY_DOT;
-		case 47:
-			return HID_KEY_SLASH;
-		default:
-			return -1;
+	int len;
+
+	while ((len = next_payload()) != 0) {
+		player.len = len;
+		player.pos = 0;
+		player.first = true;
+		player.last = true;
+
+		if (is_cancel(player.data, len)) {
+			/* Came in order, e.g. over L2CAP, only background work is left */
+			stop_all();
+			continue;
 		}
-	} else if (ascii < 58) {
-		/* Numbers */
-		if (ascii == 48U) {
-			return HID_KEY_0;
-		} else {
-			return ascii - 19;
-		}
-	} else if (ascii < 65) {
-		/* Special characters #2 */
-		switch (ascii) {
-		case 58:
-			return HID_KEY_SEMICOLON;
-		case 59:
-			return HID_KEY_SEMICOLON;
-		case 60:
-			return HID_KEY_COMMA;
-		case 61:
-			return HID_KEY_EQUAL;
-		case 62:
-			return HID_KEY_DOT;
-		case 63:
-			return HID_KEY_SLASH;
-		case 64:
-			return HID_KEY_2;
-		default:
-			return -1;
+
+		if (stream_is_chunk(player.data, len)) {
+			if (stream_chunk_begin(player.data, len, &player.first, &player.last) != 0) {
+				release_payload();
+				continue;
+			}
+			player.pos = STREAM_HDR_SIZE;
+#ifdef CONFIG_REVENGE_CACHE
+		} else if (cache_is_command(player.data, len)) {
+			/* The cache keeps its own copy of anything it plays later */
+			int err = cache_run(player.data, len);
+
+			release_payload();
+			if (err == 1) {
+				player.source = PLAY_CACHE;
+				return true;
+			}
+			continue;
+#endif
 		}
-	} else if (ascii < 91) {
-		/* Uppercase characters */
-		return ascii - 61U;
-	} else if (ascii < 97) {
-		/* Special characters #3 */
-		switch (ascii) {
-		case 91:
-			return HID_KEY_LEFTBRACE;
-		case 92:
-			return HID_KEY_BACKSLASH;
-		case 93:
-			return HID_KEY_RIGHTBRACE;
-		case 94:
-			return HID_KEY_6;
-		case 95:
-			return HID_KEY_MINUS;
-		case 96:
-			return HID_KEY_GRAVE;
-		default:
-			return -1;
+
+		/* Text, programs and compressed payloads are told apart by the stream */
+		player.source = PLAY_PAYLOAD;
+		return true;
+	}
+
+	return false;
+}
+
+static void play(struct k_work *work)
+{
+	uint32_t wait_ms = 0;
+	size_t used;
+
+	credit_update();
+
+	if (atomic_cas(&cancel_pending, 1, 0)) {
+		cancel();
+	}
+
+	if (!atomic_get(&usb_configured)) {
+		return;
+	}
+
+	/* Drain everything that arrived while we were typing */
+	while (player.source != PLAY_NONE || load_payload()) {
+		/* Let the sender refill the ring while this one is typed */
+		credit_update();
+
+#ifdef CONFIG_REVENGE_CACHE
+		if (player.source == PLAY_CACHE) {
+			if (cache_play_step(&wait_ms) == 0) {
+				player.source = PLAY_NONE;
+			}
+		} else
+#endif
+		{
+			used = stream_feed(&player.data[player.pos], player.len - player.pos,
+					   player.first, player.last, &wait_ms);
+			player.pos += used;
+			player.first = false;
+			if (player.pos == player.len && wait_ms == 0) {
+				player.source = PLAY_NONE;
+				release_payload();
+			}
 		}
-	} else if (ascii < 123) {
-		/* Lowercase letters */
-		return ascii - 93;
-	} else if (ascii < 128) {
-		/* Special characters #4 */
-		switch (ascii) {
-		case 123:
-			return HID_KEY_LEFTBRACE;
-		case 124:
-			return HID_KEY_BACKSLASH;
-		case 125:
-			return HID_KEY_RIGHTBRACE;
-		case 126:
-			return HID_KEY_GRAVE;
-		case 127:
-			return HID_KEY_DELETE;
-		default:
-			return -1;
+
+		if (wait_ms > 0) {
+			/* Picked up again where it stopped, new payloads do not cut it short */
+			k_work_reschedule_for_queue(&my_work_q, &play_work, K_MSEC(wait_ms));
+			return;
 		}
 	}
-	return -1;
 }
 
-static bool needs_shift(uint8_t ascii)
+static void play_soon(void)
 {
-	if ((ascii < 33) || (ascii == 39U)) {
-		return false;
-	} else if ((ascii >= 33U) && (ascii < 44)) {
-		return true;
-	} else if ((ascii >= 44U) && (ascii < 58)) {
-		return false;
-	} else if ((ascii == 59U) || (ascii == 61U)) {
-		return false;
-	} else if ((ascii >= 58U) && (ascii < 91)) {
-		return true;
-	} else if ((ascii >= 91U) && (ascii < 94)) {
-		return false;
-	} else if ((ascii == 94U) || (ascii == 95U)) {
-		return true;
-	} else if ((ascii > 95) && (ascii < 123)) {
-		return false;
-	} else if ((ascii > 122) && (ascii < 127)) {
-		return true;
-	} else {
-		return false;
-	}
+	k_work_schedule_for_queue(&my_work_q, &play_work, K_NO_WAIT);
 }
 
-static void status_cb(enum usb_dc_status_code status, const uint8_t *param)
+static void bt_receive_cb(struct bt_conn *conn, const uint8_t *const data,
+			  uint16_t len)
 {
-	LOG_INF("Status %d", status);
+	int err;
+
+	if (len > UART_BUF_SIZE) {
+		LOG_ERR("Payload too long (%u > %u)", len, UART_BUF_SIZE);
+		return;
+	}
+
+	link_activity();
+	credit_consume(len);
+
+	if (is_cancel(data, len)) {
+		/* Set first, the marker only tells where the payloads to drop end */
+		atomic_set(&cancel_pending, 1);
+	}
+
+	err = input_ring_put(data, len);
+	if (err) {
+		LOG_ERR("Input ring full, dropping %u bytes (err %d)", len, err);
+	}
+
+	if (is_cancel(data, len)) {
+		/* Cuts a wait short */
+		k_work_reschedule_for_queue(&my_work_q, &play_work, K_NO_WAIT);
+	} else if (err == 0) {
+		play_soon();
+	}
 }
 
-enum mouse_state {
-	MOUSE_UP,
-	MOUSE_DOWN,
-	MOUSE_RIGHT,
-	MOUSE_LEFT,
-	MOUSE_CLEAR,
-};
+static void send_enabled_cb(enum bt_nus_send_status status)
+{
+	if (status == BT_NUS_SEND_STATUS_ENABLED) {
+		credit_start(current_conn);
+		/* The initial grant is sent from the HID work queue */
+		play_soon();
+	} else {
+		credit_stop();
+	}
+}
 
-static const char mouse_cmds[][4] = {
-	[MOUSE_UP] = {0x00, 0x00, 0xE0, 0x00},
-	[MOUSE_DOWN] = {0x00, 0x00, 0x20, 0x00},
-	[MOUSE_RIGHT] = {0x00, 0x20, 0x00, 0x00},
-	[MOUSE_LEFT] = {0x00, 0xE0, 0x00, 0x00},
-	[MOUSE_CLEAR] = {0x00, 0x00, 0x00, 0x00},
+static struct bt_nus_cb nus_cb = {
+	.received = bt_receive_cb,
+	.send_enabled = send_enabled_cb,
 };
 
-static const char kbd_clear[] = {
-	0x00, 0x00, 0x00, 0x00,
-	0x00, 0x00, 0x00, 0x00
-};
+#ifdef CONFIG_REVENGE_L2CAP
+static void coc_rx_cb(void)
+{
+	link_activity();
+	play_soon();
+}
+#endif
 
-static const char toggle_caps_lock[] = {
-	0x00, 0x00, 0x00, 0x00,
-	0x00, 0x00, 0x00, HID_KEY_CAPSLOCK
-};
 
-static const char enter_cmd[] = {
-	0x00, 0x00, HID_KEY_ENTER, 0x00,
-	0x00, 0x00, 0x00, 0x00
-};
+/* HID */
 
-/* Build a report for ctrl+alt+n (open terminal) */
-static const uint8_t open_terminal_cmd[] = {
-	HID_KBD_MODIFIER_LEFT_CTRL | HID_KBD_MODIFIER_LEFT_ALT,  /* Modifiers */
-	0x00,                                                  /* Reserved */
-	HID_KEY_T,                                             /* 'n' key */
-	0x00, 0x00, 0x00, 0x00, 0x00                           /* Remaining bytes */
-};
+static const uint8_t hid_mouse_report_desc[] = HID_MOUSE_REPORT_DESC(2);
 
 const struct device *hid0_dev, *hid1_dev;
 
-static void open_terminal();
-static void send_enter();
-static void rotate_mouse(int seconds);
-static void open_url(const char *url);
+static void in_ready_cb(const struct device *dev)
+{
+	hid_out_in_ready(dev);
+}
 
-static void write_hid(const char *data, size_t size)
+static void protocol_cb(const struct device *dev, uint8_t protocol)
 {
-	int ret;
-	for (size_t i = 0; i < size; i++) {
-		if (i < size - 1 && data[i] == '\\') {
-			if (data[i + 1] == 'n') {
-				send_enter();
-				i++;
-			} else if (data[i + 1] == 't') {
-				open_terminal();
-				i++;
-			} else if (data[i + 1] == 'r') {
-				open_url("https://www.youtube.com/watch?v=xvFZjo5PgG0");
-				i++;
-			} else if (data[i + 1] == 'c') {
-				hid_int_ep_write(hid1_dev, toggle_caps_lock, sizeof(toggle_caps_lock), NULL);
-				i++;
-			} else if (data[i + 1] == 's') {
-				k_sleep(K_MSEC(1000));
-				i++;
-				continue;
-			} else if (data[i + 1] == 'm') {
-				rotate_mouse(10);
-				i++;
-				continue;
-			} else if (data[i + 1] == 'u') {
-				static char url[256];
-				memcpy(url, &data[i + 2], size - i - 2);
-				url[size - i - 2] = '\0';
-				open_url(url);
-				return;
-			} else if (data[i + 1] == 'x') {
-				static char url[256];
-				memcpy(url, &data[i + 2], size - i - 2);
-				url[size - i - 2] = '\0';
-				open_url(url);
-				rotate_mouse(60);
-				return;
-			} else {
-				continue;
-			}
-		}
-		else {
-			int key = ascii_to_hid(data[i]);
-			if (key < 0) {
-				continue;  // Skip unsupported characters
-			}
-			uint8_t report[8] = {0};  // [modifier, reserved, key1, key2, ..., key6]
+	if (dev == hid1_dev) {
+		kbd_set_boot_protocol(protocol == HID_PROTOCOL_BOOT);
+	}
+}
 
-			if (needs_shift(data[i])) {
-				report[0] |= HID_KBD_MODIFIER_RIGHT_SHIFT;
-			}
-			/* Place key code in first key position (index 2) */
-			report[2] = key;
+static const struct hid_ops ops = {
+	.int_in_ready = in_ready_cb,
+	.protocol_change = protocol_cb,
+};
 
-			ret = hid_int_ep_write(hid1_dev, report, sizeof(report), NULL);
-			if (ret < 0) {
-				LOG_ERR("Failed to write key press report");
-				return;
-			}
-		}
+static void status_cb(enum usb_dc_status_code status, const uint8_t *param)
+{
+	LOG_INF("Status %d", status);
+
+	switch (status) {
+	case USB_DC_RESET:
+		/* The host has to ask for the boot protocol again */
+		kbd_set_boot_protocol(false);
+		atomic_set(&usb_configured, 0);
+		/* Nothing in flight survives a reset */
+		hid_out_reset();
+		break;
+	case USB_DC_CONFIGURED:
+		hid_out_reset();
+		atomic_set(&usb_configured, 1);
+		boot_mark(BOOT_USB_CONFIGURED);
+		/* Type whatever arrived while enumerating */
+		play_soon();
+		break;
+	case USB_DC_DISCONNECTED:
+		atomic_set(&usb_configured, 0);
+		break;
+	default:
+		break;
+	}
+}
 
-		/* Small delay to simulate key press duration */
-		k_sleep(K_MSEC(10));
+static void bt_ready(int err)
+{
+	if (err) {
+		LOG_ERR("Bluetooth init failed (err %d)", err);
+		return;
+	}
 
-		/* Send release report */
-		ret = hid_int_ep_write(hid1_dev, kbd_clear, sizeof(kbd_clear), NULL);
-		if (ret < 0) {
-			LOG_ERR("Failed to write key release report");
-			return;
-		}
+	boot_mark(BOOT_BT_READY);
 
-		/* Small delay between keys */
-		k_sleep(K_MSEC(10));
+	/* Bonds, so a known peer reconnects without pairing again */
+	err = settings_load();
+	if (err) {
+		LOG_WRN("Failed to load settings (err %d)", err);
 	}
-}
 
+	err = bt_nus_init(&nus_cb);
+	if (err) {
+		LOG_ERR("Failed to initialize UART service (err: %d)", err);
+		return;
+	}
 
+#ifdef CONFIG_REVENGE_L2CAP
+	err = coc_init(coc_rx_cb);
+	if (err) {
+		return;
+	}
+#endif
 
+	advertise(true);
+	boot_mark(BOOT_ADVERTISING);
+}
 
 int main(void)
 {
 	int ret;
 
+	boot_mark(BOOT_MAIN);
+
 	k_work_queue_init(&my_work_q);
 
 	k_work_queue_start(&my_work_q, my_stack_area,
                    K_THREAD_STACK_SIZEOF(my_stack_area), 2,
                    NULL);
 
+	k_work_queue_init(&mouse_work_q);
+
+	k_work_queue_start(&mouse_work_q, mouse_stack_area,
+                   K_THREAD_STACK_SIZEOF(mouse_stack_area), 2,
+                   NULL);
+
 	/* Configure devices */
 	hid0_dev = device_get_binding("HID_0");
 	if (hid0_dev == NULL) {
@@ -429,128 +549,46 @@ int main(void)
 		return 0;
 	}
 
-	k_work_init(&send_keys_work, send_keys);
+	k_work_init_delayable(&play_work, play);
+
+	hid_out_init(hid0_dev, hid1_dev);
+	mouse_init(&mouse_work_q);
+
+	/* Bluetooth comes up in the background while USB enumerates */
+	link_init();
+
+	ret = bt_enable(bt_ready);
+	if (ret) {
+		LOG_ERR("Bluetooth init failed (err %d)", ret);
+		return 0;
+	}
+
+#ifdef CONFIG_REVENGE_CACHE
+	/* Mounted before USB, nothing is played until the host configures us.
+	 * Payloads can still be sent if it fails, they just cannot be cached.
+	 */
+	(void)cache_init();
+#endif
 
 	/* Initialize HID devices */
 	usb_hid_register_device(hid0_dev, hid_mouse_report_desc,
 				sizeof(hid_mouse_report_desc), &ops);
-	usb_hid_register_device(hid1_dev, hid_kbd_report_desc,
-				sizeof(hid_kbd_report_desc), &ops);
+	usb_hid_register_device(hid1_dev, kbd_report_desc,
+				kbd_report_desc_size, &ops);
+
+#ifdef CONFIG_REVENGE_KBD_NKRO
+	/* Lets BIOS-style hosts fall back to boot reports */
+	usb_hid_set_proto_code(hid1_dev, HID_BOOT_IFACE_CODE_KEYBOARD);
+#endif
 
 	usb_hid_init(hid0_dev);
 	usb_hid_init(hid1_dev);
 
-
 	ret = usb_enable(status_cb);
 	if (ret != 0) {
 		LOG_ERR("Failed to enable USB");
 		return 0;
 	}
 
-	k_busy_wait(USEC_PER_SEC);
-	k_sleep(K_MSEC(1000));
-
-
-	ret = bt_enable(NULL);
-	if (ret) {
-		return 0;
-	}
-
-
-	ret = bt_nus_init(&nus_cb);
-	if (ret) {
-		LOG_ERR("Failed to initialize UART service (err: %d)", ret);
-		return 0;
-	}
-
-
-	ret = bt_le_adv_start(BT_LE_ADV_CONN, ad, ARRAY_SIZE(ad), sd, ARRAY_SIZE(sd));
-	if (ret) {
-		LOG_ERR("Advertising failed to start (err %d)", ret);
-		return 0;
-	}
-
-
-}
-
-
-
-// ============================ special sequences ============================
-
-static void open_url(const char *url)
-{
-	static char cmd[256];
-	int len = sprintf(cmd, "xdg-open %s", url);
-
-	open_terminal();
-	k_sleep(K_MSEC(1500));
-	write_hid(cmd, len);
-	k_sleep(K_MSEC(10));
-	send_enter();
-}
-
-static void open_terminal()
-{
-	hid_int_ep_write(hid1_dev, open_terminal_cmd, sizeof(open_terminal_cmd), NULL);
-	k_sleep(K_MSEC(10));
-	hid_int_ep_write(hid1_dev, kbd_clear, sizeof(kbd_clear), NULL);
-}
-
-static void send_enter()
-{
-	hid_int_ep_write(hid1_dev, enter_cmd, sizeof(enter_cmd), NULL);
-	k_sleep(K_MSEC(10));
-	hid_int_ep_write(hid1_dev, kbd_clear, sizeof(kbd_clear), NULL);
-}
-
-
-static void rotate_mouse(int seconds)
-{
-    int64_t end_time = k_uptime_get() + (seconds * MSEC_PER_SEC);
-    float angle = 0.0f;
-    /* Increase amplitude to make movements bigger */
-    int amplitude = 200;  // Adjust amplitude for larger movement
-    /* Adjust angle_step to control the smoothness/speed of the circle */
-    float angle_step = 0.2f;  // In radians
-
-    while (k_uptime_get() < end_time) {
-        /* Calculate the x and y offsets based on a circular path */
-        int8_t x = (int8_t)(amplitude * cosf(angle));
-        int8_t y = (int8_t)(amplitude * sinf(angle));
-
-        /* Build a dynamic mouse report:
-           Byte 0: buttons (none pressed: 0x00)
-           Byte 1: X-axis movement
-           Byte 2: Y-axis movement
-           Byte 3: wheel/scroll (0x00)
-        */
-        uint8_t report[4] = {0, (uint8_t)x, (uint8_t)y, 0};
-
-        int ret = hid_int_ep_write(hid0_dev, report, sizeof(report), NULL);
-        if (ret < 0) {
-            LOG_ERR("Failed to write mouse report");
-            return;
-        }
-
-        k_sleep(K_MSEC(100));
-
-        /* Send a clear report to signal the end of this movement */
-        ret = hid_int_ep_write(hid0_dev, mouse_cmds[MOUSE_CLEAR], sizeof(mouse_cmds[MOUSE_CLEAR]), NULL);
-        if (ret < 0) {
-            LOG_ERR("Failed to write mouse clear report");
-            return;
-        }
-
-        k_sleep(K_MSEC(100));
-
-        /* Increment the angle for the next step */
-        angle += angle_step;
-        if (angle >= 2 * M_PI) {
-            angle -= 2 * M_PI;
-        }
-    }
+	return 0;
 }
-
-
-
-
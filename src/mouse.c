@@ -0,0 +1,214 @@
+/**
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#include <zephyr/kernel.h>
+#include <zephyr/sys/atomic.h>
+#include <zephyr/logging/log.h>
+
+#include "mouse.h"
+#include "hid_out.h"
+#include "path.h"
+
+LOG_MODULE_REGISTER(mouse);
+
+#define MOUSE_BTN_REPORT_POS	0
+#define MOUSE_X_REPORT_POS	1
+#define MOUSE_Y_REPORT_POS	2
+#define MOUSE_WHEEL_REPORT_POS	3
+
+#define MOUSE_STEP_MAX		PATH_STEP_MAX
+
+/* Where the reports have moved the pointer since the origin */
+static atomic_t pos_x;
+static atomic_t pos_y;
+
+/* Far enough to reach the corner of any screen from anywhere on it */
+#define HOME_TRAVEL		8192
+
+int mouse_report(uint8_t buttons, int8_t dx, int8_t dy, int8_t wheel)
+{
+	uint8_t report[4];
+	int ret;
+
+	report[MOUSE_BTN_REPORT_POS] = buttons;
+	report[MOUSE_X_REPORT_POS] = (uint8_t)dx;
+	report[MOUSE_Y_REPORT_POS] = (uint8_t)dy;
+	report[MOUSE_WHEEL_REPORT_POS] = (uint8_t)wheel;
+
+	ret = hid_out_write(HID_OUT_MOUSE, report, sizeof(report));
+	if (ret < 0) {
+		LOG_ERR("Failed to write mouse report");
+		return ret;
+	}
+
+	atomic_add(&pos_x, dx);
+	atomic_add(&pos_y, dy);
+
+	return ret;
+}
+
+int mouse_path(uint8_t buttons, struct path *path)
+{
+	int32_t done_x = 0;
+	int32_t done_y = 0;
+	int32_t x, y;
+
+	if (path_steps(path) == 0) {
+		return mouse_report(buttons, 0, 0, 0);
+	}
+
+	/*
+	 * Each point is one report, the path keeps them in the int8 range.
+	 * Anything further is still split rather than wrapped around.
+	 */
+	while (path_next(path, &x, &y)) {
+		while (x != done_x || y != done_y) {
+			int dx = CLAMP(x - done_x, -MOUSE_STEP_MAX, MOUSE_STEP_MAX);
+			int dy = CLAMP(y - done_y, -MOUSE_STEP_MAX, MOUSE_STEP_MAX);
+			int ret;
+
+			ret = mouse_report(buttons, dx, dy, 0);
+			if (ret < 0) {
+				return ret;
+			}
+			done_x += dx;
+			done_y += dy;
+		}
+	}
+
+	return 0;
+}
+
+int mouse_move(uint8_t buttons, int16_t dx, int16_t dy)
+{
+	struct path path;
+
+	/* Spread the offset evenly so the pointer travels in a straight line */
+	path_line(&path, dx, dy);
+
+	return mouse_path(buttons, &path);
+}
+
+int mouse_move_to(uint8_t buttons, int16_t x, int16_t y)
+{
+	int32_t dx = x - (int32_t)atomic_get(&pos_x);
+	int32_t dy = y - (int32_t)atomic_get(&pos_y);
+
+	return mouse_move(buttons, CLAMP(dx, INT16_MIN, INT16_MAX),
+			  CLAMP(dy, INT16_MIN, INT16_MAX));
+}
+
+int mouse_home(void)
+{
+	int ret = mouse_move(0, -HOME_TRAVEL, -HOME_TRAVEL);
+
+	if (ret == 0) {
+		atomic_set(&pos_x, 0);
+		atomic_set(&pos_y, 0);
+	}
+
+	return ret;
+}
+
+int mouse_arc(uint8_t buttons, int16_t cx, int16_t cy, int16_t degrees)
+{
+	struct path path;
+
+	path_arc(&path, cx, cy, degrees);
+
+	return mouse_path(buttons, &path);
+}
+
+int mouse_curve(uint8_t buttons, int16_t x1, int16_t y1, int16_t x2, int16_t y2,
+		int16_t x, int16_t y)
+{
+	struct path path;
+
+	path_curve(&path, x1, y1, x2, y2, x, y);
+
+	return mouse_path(buttons, &path);
+}
+
+/* Circle radius in pixels and time for one turn */
+#define ROTATE_RADIUS		200
+#define ROTATE_PERIOD_MS	1000
+
+/*
+ * Circles run in the background, one report per step. The pointer follows
+ * a circle through where it started, the position on it comes from the
+ * time elapsed, and each report moves it from where the last one left it.
+ * What a report cannot carry, a fraction of a pixel or more than it fits,
+ * is sent with the next one. Only the mouse queue touches this state,
+ * requests are handed over in rotate_request (seconds, or -1 for none).
+ */
+static struct k_work_q *rotate_queue;
+static struct k_work_delayable rotate_work;
+static atomic_t rotate_request = ATOMIC_INIT(-1);
+static int64_t rotate_start;
+static int64_t rotate_end;
+/* Offset from the start sent so far */
+static int32_t rotate_x;
+static int32_t rotate_y;
+
+static void rotate_step(struct k_work *work)
+{
+	int seconds = atomic_set(&rotate_request, -1);
+	int64_t now = k_uptime_get();
+	int64_t elapsed;
+	uint16_t phase;
+	int32_t x, y;
+	int dx, dy;
+
+	if (seconds >= 0) {
+		/* Start over */
+		rotate_start = now;
+		rotate_end = now + (seconds * MSEC_PER_SEC);
+		rotate_x = 0;
+		rotate_y = 0;
+	}
+
+	/* The last step lands exactly where the time ran out */
+	elapsed = MIN(now, rotate_end) - rotate_start;
+	phase = (uint16_t)(((elapsed % ROTATE_PERIOD_MS) << 16) / ROTATE_PERIOD_MS);
+	x = ((ROTATE_RADIUS * path_cos_q15(phase) + BIT(14)) >> 15) - ROTATE_RADIUS;
+	y = (ROTATE_RADIUS * path_sin_q15(phase) + BIT(14)) >> 15;
+
+	dx = CLAMP(x - rotate_x, -MOUSE_STEP_MAX, MOUSE_STEP_MAX);
+	dy = CLAMP(y - rotate_y, -MOUSE_STEP_MAX, MOUSE_STEP_MAX);
+
+	if (dx != 0 || dy != 0) {
+		if (mouse_report(0, dx, dy, 0) < 0) {
+			return;
+		}
+		rotate_x += dx;
+		rotate_y += dy;
+	} else if (now >= rotate_end) {
+		return;
+	}
+
+	k_work_reschedule_for_queue(rotate_queue, &rotate_work,
+				    K_MSEC(CONFIG_REVENGE_MOUSE_STEP_MS));
+}
+
+void mouse_init(struct k_work_q *queue)
+{
+	rotate_queue = queue;
+	k_work_init_delayable(&rotate_work, rotate_step);
+}
+
+void mouse_rotate(int seconds)
+{
+	atomic_set(&rotate_request, MAX(seconds, 0));
+	k_work_reschedule_for_queue(rotate_queue, &rotate_work, K_NO_WAIT);
+}
+
+void mouse_stop(void)
+{
+	/* Ends the circles on the mouse queue, even one that is running now */
+	mouse_rotate(0);
+}
+
+bool mouse_busy(void)
+{
+	return k_work_delayable_busy_get(&rotate_work) != 0;
+}
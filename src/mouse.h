@@ -0,0 +1,68 @@
+/**
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#ifndef REVENGE_MOUSE_H_
+#define REVENGE_MOUSE_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <zephyr/sys/util.h>
+
+#define MOUSE_BTN_LEFT		BIT(0)
+#define MOUSE_BTN_RIGHT		BIT(1)
+#define MOUSE_BTN_MIDDLE	BIT(2)
+
+/* Send a single relative report, buttons are held until the next one. */
+int mouse_report(uint8_t buttons, int8_t dx, int8_t dy, int8_t wheel);
+
+/* Move by an arbitrary offset, split into as many reports as needed. */
+int mouse_move(uint8_t buttons, int16_t dx, int16_t dy);
+
+/*
+ * Paths are sent as the fewest reports that follow them, see path.h. Like
+ * mouse_move() they are queued by the caller. Offsets are relative to
+ * where the pointer is when the path starts.
+ */
+struct path;
+
+int mouse_path(uint8_t buttons, struct path *path);
+
+/* Arc around cx, cy, clockwise on screen for positive degrees. */
+int mouse_arc(uint8_t buttons, int16_t cx, int16_t cy, int16_t degrees);
+
+/* Cubic Bezier curve to x, y through the control points x1, y1 and x2, y2. */
+int mouse_curve(uint8_t buttons, int16_t x1, int16_t y1, int16_t x2, int16_t y2,
+		int16_t x, int16_t y);
+
+/*
+ * Move to a position relative to the origin, the top left corner of the
+ * screen after mouse_home() or where the pointer was at boot. The position
+ * is tracked from the reports sent, so host pointer acceleration must be
+ * off for it to land on the right pixel.
+ */
+int mouse_move_to(uint8_t buttons, int16_t x, int16_t y);
+
+/* Push the pointer into the top left corner and make it the origin. */
+int mouse_home(void);
+
+struct k_work_q;
+
+/*
+ * Set the work queue background movements run on. With a queue of its own
+ * the mouse is not held up by typing, and both go out in the same frame.
+ */
+void mouse_init(struct k_work_q *queue);
+
+/*
+ * Move the pointer in circles for the given time. Returns right away, the
+ * circles run in the background and a new call starts over.
+ */
+void mouse_rotate(int seconds);
+
+/* Stop a background movement. */
+void mouse_stop(void);
+
+/* Whether a background movement is running. */
+bool mouse_busy(void);
+
+#endif /* REVENGE_MOUSE_H_ */
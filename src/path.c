@@ -0,0 +1,203 @@
+/**
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#include <stdlib.h>
+
+#include "path.h"
+
+/* Rounding the ends of a chord can add a pixel to it */
+#define CHORD_MAX (PATH_STEP_MAX - 1)
+
+/* Radians per degree in Q16, rounded up so step counts are never short */
+#define RAD_PER_DEG_Q16 1144
+
+#define Q15_ONE 32767
+
+/*
+ * Worst error of a point on an arc per pixel of radius, in Q16: the
+ * interpolated sine is off by up to 1.1e-4 on each of the two terms of a
+ * coordinate, and the phase by half a step of 2 pi / 0x10000.
+ */
+#define ARC_ERR_Q16 14
+
+/* A quarter of a sine wave in Q15, 64 steps from 0 to pi/2 */
+static const int16_t sine_quarter[65] = {
+	0, 804, 1608, 2410, 3212, 4011, 4808, 5602,
+	6393, 7179, 7962, 8739, 9512, 10278, 11039, 11793,
+	12539, 13279, 14010, 14732, 15446, 16151, 16846, 17530,
+	18204, 18868, 19519, 20159, 20787, 21403, 22005, 22594,
+	23170, 23731, 24279, 24811, 25329, 25832, 26319, 26790,
+	27245, 27683, 28105, 28510, 28898, 29268, 29621, 29956,
+	30273, 30571, 30852, 31113, 31356, 31580, 31785, 31971,
+	32137, 32285, 32412, 32521, 32609, 32678, 32728, 32757,
+	32767,
+};
+
+int32_t path_sin_q15(uint16_t phase)
+{
+	uint16_t quarter = phase & 0x3FFF;
+	uint16_t idx, frac;
+	int32_t val;
+
+	if (phase & 0x4000) {
+		quarter = 0x4000 - quarter;
+	}
+	idx = quarter >> 8;
+	frac = quarter & 0xFF;
+
+	/* Linear in between, off by less than 1e-4 */
+	val = sine_quarter[idx];
+	if (frac != 0) {
+		val += ((sine_quarter[idx + 1] - val) * frac) >> 8;
+	}
+
+	return (phase & 0x8000) ? -val : val;
+}
+
+int32_t path_cos_q15(uint16_t phase)
+{
+	return path_sin_q15(phase + 0x4000);
+}
+
+static int64_t div_round(int64_t num, int64_t den)
+{
+	return (num >= 0 ? num + den / 2 : num - den / 2) / den;
+}
+
+static uint64_t div_ceil(uint64_t num, uint64_t den)
+{
+	return (num + den - 1) / den;
+}
+
+/* Smallest r with r * r >= v */
+static uint32_t sqrt_ceil(uint64_t v)
+{
+	uint64_t lo = 0;
+	uint64_t hi = 0xFFFFFFFF;
+
+	while (lo < hi) {
+		uint64_t mid = (lo + hi) / 2;
+
+		if (mid * mid >= v) {
+			hi = mid;
+		} else {
+			lo = mid + 1;
+		}
+	}
+
+	return lo;
+}
+
+static uint32_t max_u32(uint32_t a, uint32_t b)
+{
+	return a > b ? a : b;
+}
+
+void path_line(struct path *path, int16_t dx, int16_t dy)
+{
+	path->kind = PATH_LINE;
+	path->pt[0] = dx;
+	path->pt[1] = dy;
+	path->steps = div_ceil(max_u32(abs(dx), abs(dy)), PATH_STEP_MAX);
+	path->step = 0;
+}
+
+/*
+ * A chord of angle a on radius r is at most r * a long and strays up to
+ * r * a^2 / 8 from the arc, which sets the largest angle per step. Both
+ * ends of a chord can also be off by the error of the fixed-point angles,
+ * which grows with the radius.
+ */
+void path_arc(struct path *path, int16_t cx, int16_t cy, int16_t degrees)
+{
+	uint64_t rad_q16 = (uint64_t)abs(degrees) * RAD_PER_DEG_Q16;
+	uint32_t r = sqrt_ceil((int64_t)cx * cx + (int64_t)cy * cy);
+	uint32_t chord = CHORD_MAX - 2 * div_ceil((uint64_t)r * ARC_ERR_Q16, 1 << 16);
+	uint32_t by_len = div_ceil(rad_q16 * r, (uint64_t)chord << 16);
+	uint32_t by_err = div_ceil(rad_q16 * sqrt_ceil((uint64_t)r * 8 / PATH_TOLERANCE),
+				   8 << 16);
+
+	path->kind = PATH_ARC;
+	path->pt[0] = cx;
+	path->pt[1] = cy;
+	path->degrees = degrees;
+	path->steps = r == 0 ? 0 : max_u32(max_u32(by_len, by_err), 1);
+	path->step = 0;
+}
+
+/*
+ * Chords over 1/n of the curve's parameter are at most max|B'| / n long
+ * and stray up to max|B''| / (8 n^2) from it. B' and B'' are bounded by
+ * the differences of the control points.
+ */
+void path_curve(struct path *path, int16_t x1, int16_t y1, int16_t x2, int16_t y2,
+		int16_t x, int16_t y)
+{
+	int32_t px[4] = { 0, x1, x2, x };
+	int32_t py[4] = { 0, y1, y2, y };
+	uint32_t len = 0;
+	uint32_t bend = 0;
+
+	for (int i = 0; i < 3; i++) {
+		len = max_u32(len, max_u32(abs(px[i + 1] - px[i]), abs(py[i + 1] - py[i])));
+	}
+	for (int i = 0; i < 2; i++) {
+		bend = max_u32(bend, abs(px[i] - 2 * px[i + 1] + px[i + 2]) +
+				     abs(py[i] - 2 * py[i + 1] + py[i + 2]));
+	}
+
+	path->kind = PATH_CURVE;
+	for (int i = 0; i < 3; i++) {
+		path->pt[2 * i] = px[i + 1];
+		path->pt[2 * i + 1] = py[i + 1];
+	}
+	path->steps = max_u32(div_ceil(3 * (uint64_t)len, CHORD_MAX),
+			      sqrt_ceil(div_ceil(3 * (uint64_t)bend, 4 * PATH_TOLERANCE)));
+	if (len == 0) {
+		path->steps = 0;
+	}
+	path->step = 0;
+}
+
+bool path_next(struct path *path, int32_t *x, int32_t *y)
+{
+	int64_t n = path->steps;
+	int64_t i;
+
+	if (path->step >= path->steps) {
+		return false;
+	}
+	i = ++path->step;
+
+	switch (path->kind) {
+	case PATH_LINE:
+		*x = path->pt[0] * i / n;
+		*y = path->pt[1] * i / n;
+		break;
+	case PATH_ARC: {
+		/* Turn the start around the centre, a phase of 0x10000 per turn */
+		uint16_t phase = (uint16_t)div_round((int64_t)path->degrees * i * 0x10000, 360 * n);
+		int64_t c = path_cos_q15(phase);
+		int64_t s = path_sin_q15(phase);
+		int64_t vx = -path->pt[0];
+		int64_t vy = -path->pt[1];
+
+		*x = path->pt[0] + div_round(vx * c - vy * s, Q15_ONE);
+		*y = path->pt[1] + div_round(vx * s + vy * c, Q15_ONE);
+		break;
+	}
+	case PATH_CURVE: {
+		/* Bernstein form at t = i / n, scaled by n^3 */
+		int64_t a = n - i;
+		int64_t n3 = n * n * n;
+
+		*x = div_round(3 * a * a * i * path->pt[0] + 3 * a * i * i * path->pt[2] +
+			       i * i * i * path->pt[4], n3);
+		*y = div_round(3 * a * a * i * path->pt[1] + 3 * a * i * i * path->pt[3] +
+			       i * i * i * path->pt[5], n3);
+		break;
+	}
+	}
+
+	return true;
+}
@@ -0,0 +1,68 @@
+/**
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#ifndef REVENGE_PATH_H_
+#define REVENGE_PATH_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+ * Pointer paths split into relative mouse reports.
+ *
+ * A path is walked as a series of points, each one the end of a straight
+ * report from the last. Points are relative to where the path starts and
+ * come as few as possible: a report moves up to PATH_STEP_MAX on each axis
+ * (the int8 X/Y of the mouse report) and a curve is cut into chords that
+ * stay within PATH_TOLERANCE pixels of it. Only integer math is used, the
+ * angles through a fixed-point sine table.
+ *
+ * This header is shared with the host-side compiler, which counts the
+ * reports a program sends, and must stay free of Zephyr dependencies.
+ */
+
+#define PATH_STEP_MAX  127
+#define PATH_TOLERANCE 1
+
+enum path_kind {
+	PATH_LINE,
+	PATH_ARC,
+	PATH_CURVE,
+};
+
+struct path {
+	enum path_kind kind;
+	/* End of a line, centre of an arc or the three points of a curve */
+	int32_t pt[6];
+	int32_t degrees;
+	uint32_t steps;
+	uint32_t step;
+};
+
+/* Sine and cosine in Q15 of a phase where 0x10000 is a full turn. */
+int32_t path_sin_q15(uint16_t phase);
+int32_t path_cos_q15(uint16_t phase);
+
+/* Straight line to dx, dy. */
+void path_line(struct path *path, int16_t dx, int16_t dy);
+
+/*
+ * Arc around the centre cx, cy for the given angle, clockwise on screen
+ * when positive. Turns further than a full circle go round again.
+ */
+void path_arc(struct path *path, int16_t cx, int16_t cy, int16_t degrees);
+
+/* Cubic Bezier curve through the control points x1, y1 and x2, y2 to x, y. */
+void path_curve(struct path *path, int16_t x1, int16_t y1, int16_t x2, int16_t y2,
+		int16_t x, int16_t y);
+
+/* Next point, false once the end has been reached. */
+bool path_next(struct path *path, int32_t *x, int32_t *y);
+
+/* Number of points, i.e. reports, on the whole path. */
+static inline uint32_t path_steps(const struct path *path)
+{
+	return path->steps;
+}
+
+#endif /* REVENGE_PATH_H_ */
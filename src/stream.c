@@ -0,0 +1,294 @@
+/**
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#include <zephyr/kernel.h>
+#include <zephyr/sys/byteorder.h>
+#include <zephyr/logging/log.h>
+#include <string.h>
+#include <errno.h>
+
+#include "stream.h"
+#include "bytecode.h"
+#include "cache.h"
+#include "kbd.h"
+#include "lz.h"
+#include "text.h"
+
+LOG_MODULE_REGISTER(stream);
+
+enum stream_state {
+	STREAM_IDLE,
+	STREAM_TEXT,
+	STREAM_PROGRAM,
+	/* Written to the payload cache instead of played */
+	STREAM_STORE,
+	/* Skip chunks up to the end of an aborted or finished payload */
+	STREAM_SKIP,
+};
+
+static enum stream_state state;
+/* Between the first and the last chunk of a payload */
+static bool in_payload;
+static uint8_t next_seq;
+
+/* Compressed payloads are decoded on the way in, nothing else is buffered */
+static struct lz_dec lz;
+static bool compressed;
+static bool lz_first;
+
+/* Tail of the previous chunk that could not be run yet */
+static uint8_t carry[CONFIG_REVENGE_STREAM_BUF_SIZE];
+static size_t carry_len;
+
+static void skip_rest(void)
+{
+#ifdef CONFIG_REVENGE_CACHE
+	if (state == STREAM_STORE) {
+		cache_store_end(false);
+	}
+#endif
+	kbd_release();
+	state = STREAM_SKIP;
+	carry_len = 0;
+}
+
+static void begin(const uint8_t **data, size_t *size)
+{
+	if (state != STREAM_IDLE && state != STREAM_SKIP) {
+		LOG_WRN("Payload restarted, dropping the rest of the previous one");
+		skip_rest();
+	}
+	carry_len = 0;
+
+	if (bc_is_program(*data, *size)) {
+		state = STREAM_PROGRAM;
+		*data += 1;
+		*size -= 1;
+#ifdef CONFIG_REVENGE_CACHE
+	} else if (cache_is_store(*data, *size)) {
+		state = cache_store_begin(sys_get_le32(&(*data)[2])) == 0 ? STREAM_STORE
+									   : STREAM_SKIP;
+		*data += CACHE_HDR_SIZE;
+		*size -= CACHE_HDR_SIZE;
+#endif
+	} else {
+		state = STREAM_TEXT;
+		text_cancel();
+	}
+}
+
+/* Text or a program, an error or END drops the rest of the payload */
+static int feed(const uint8_t *data, size_t size, bool last, size_t *used, uint32_t *wait_ms)
+{
+	int ret;
+
+	if (state == STREAM_TEXT) {
+		*used = text_feed(data, size, last, wait_ms);
+		return 0;
+	}
+
+	ret = bc_feed(data, size, last, used, wait_ms);
+	if (ret != 0) {
+		skip_rest();
+	}
+
+	return ret;
+}
+
+/*
+ * Finish the command split off the previous piece. How long it is only
+ * shows once it has run, so as much of the piece as fits is copied after it
+ * and only what the command took of that counts as used. Moves data past
+ * it, anything that was not run stays in place.
+ */
+static int play_carry(const uint8_t **data, size_t *size, bool last, uint32_t *wait_ms)
+{
+	size_t kept = carry_len;
+	size_t taken = MIN(*size, sizeof(carry) - carry_len);
+	size_t used;
+	int ret;
+
+	/* With nothing more to take, e.g. after a wait, the carry runs alone */
+	if (taken == 0 && *size > 0) {
+		LOG_ERR("Command longer than %zu bytes, dropping payload", sizeof(carry));
+		skip_rest();
+		return -ENOMEM;
+	}
+	memcpy(&carry[carry_len], *data, taken);
+
+	ret = feed(carry, carry_len + taken, last && taken == *size, &used, wait_ms);
+	if (ret != 0) {
+		return ret;
+	}
+
+	if (used >= kept) {
+		/* Past the carried bytes, the rest is taken from the piece again */
+		carry_len = 0;
+		*data += used - kept;
+		*size -= used - kept;
+	} else if (*wait_ms > 0) {
+		/* Stopped in the carried bytes, they are run on after the wait */
+		carry_len = kept - used;
+		memmove(carry, &carry[used], carry_len);
+	} else {
+		/* Still cut off, all of it waits for the next piece */
+		carry_len = kept + taken - used;
+		memmove(carry, &carry[used], carry_len);
+		*data += taken;
+		*size -= taken;
+	}
+
+	return 0;
+}
+
+/* Returns how much input was used, the rest waits with the caller */
+static size_t play(const uint8_t *data, size_t size, bool first, bool last, uint32_t *wait_ms)
+{
+	const uint8_t *start = data;
+	const uint8_t *end = data + size;
+	size_t used;
+
+	if (first) {
+		begin(&data, &size);
+	}
+
+	switch (state) {
+	case STREAM_IDLE:
+	case STREAM_SKIP:
+		data = end;
+		goto out;
+#ifdef CONFIG_REVENGE_CACHE
+	case STREAM_STORE:
+		if (cache_store_append(data, size) != 0) {
+			skip_rest();
+		} else if (last) {
+			cache_store_end(true);
+		}
+		data = end;
+		goto out;
+#endif
+	default:
+		break;
+	}
+
+	if (carry_len > 0) {
+		if (play_carry(&data, &size, last, wait_ms) != 0) {
+			data = end;
+			goto out;
+		}
+		if (*wait_ms > 0 || carry_len > 0 || size == 0) {
+			goto out;
+		}
+	}
+
+	if (feed(data, size, last, &used, wait_ms) != 0) {
+		data = end;
+		goto out;
+	}
+
+	if (*wait_ms > 0) {
+		/* Passed again once the wait is over */
+		data += used;
+		goto out;
+	}
+
+	carry_len = size - used;
+	if (carry_len > sizeof(carry)) {
+		LOG_ERR("Command longer than %zu bytes, dropping payload", sizeof(carry));
+		skip_rest();
+		data = end;
+		goto out;
+	}
+	memcpy(carry, &data[used], carry_len);
+	data = end;
+
+out:
+	if (last && data == end && *wait_ms == 0 && carry_len == 0) {
+		state = STREAM_IDLE;
+	}
+
+	return data - start;
+}
+
+static size_t play_decoded(const uint8_t *data, size_t size, bool last, void *ctx)
+{
+	uint32_t *wait_ms = ctx;
+	size_t used;
+
+	/* Nothing more until the wait is over */
+	if (*wait_ms > 0) {
+		return 0;
+	}
+
+	used = play(data, size, lz_first, last, wait_ms);
+	lz_first = false;
+
+	return used;
+}
+
+size_t stream_feed(const uint8_t *data, size_t size, bool first, bool last, uint32_t *wait_ms)
+{
+	size_t header = 0;
+	size_t used;
+
+	*wait_ms = 0;
+	in_payload = !last;
+
+	if (first) {
+		compressed = lz_is_compressed(data, size);
+		if (compressed) {
+			lz_init(&lz);
+			lz_first = true;
+			header = 1;
+		}
+	}
+
+	if (!compressed) {
+		return play(data, size, first, last, wait_ms);
+	}
+
+	if (lz_feed(&lz, &data[header], size - header, last, play_decoded, wait_ms, &used) != 0) {
+		LOG_ERR("Corrupt compressed payload");
+		skip_rest();
+		compressed = false;
+		if (last) {
+			state = STREAM_IDLE;
+		}
+		return size;
+	}
+
+	return header + used;
+}
+
+int stream_chunk_begin(const uint8_t *chunk, size_t len, bool *first, bool *last)
+{
+	uint8_t seq = chunk[1];
+	uint8_t flags = chunk[2];
+
+	if (!(flags & STREAM_FLAG_START)) {
+		if (!in_payload) {
+			LOG_WRN("Chunk %u without a start, dropped", seq);
+			return -EINVAL;
+		}
+		if (state != STREAM_SKIP && seq != next_seq) {
+			LOG_ERR("Chunk %u missing (got %u), dropping payload", next_seq, seq);
+			skip_rest();
+		}
+	}
+	next_seq = seq + 1;
+
+	*first = (flags & STREAM_FLAG_START) != 0;
+	*last = (flags & STREAM_FLAG_END) != 0;
+
+	return 0;
+}
+
+void stream_cancel(void)
+{
+	skip_rest();
+	/* Chunks of the cancelled payload that are still to come are dropped */
+	state = in_payload ? STREAM_SKIP : STREAM_IDLE;
+	compressed = false;
+	text_cancel();
+	bc_cancel();
+}
@@ -0,0 +1,62 @@
+/**
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#ifndef REVENGE_STREAM_H_
+#define REVENGE_STREAM_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Streamed payloads.
+ *
+ * A payload too large for a single write is sent as a series of chunks,
+ * each one a NUS write of its own:
+ *
+ *   STREAM_MAGIC seq:u8 flags:u8 data[]
+ *
+ * The first chunk has STREAM_FLAG_START and seq 0, every following chunk
+ * the next seq (wrapping at 256) and the last one STREAM_FLAG_END. The data
+ * of all chunks put together is an ordinary text or bytecode payload, which
+ * starts to play as soon as the first chunk is in, or a payload cache store
+ * command (cache.h). A missing chunk aborts the payload and the rest of it
+ * is dropped.
+ *
+ * This header is shared with the host-side compiler and must stay free of
+ * Zephyr dependencies.
+ */
+
+#define STREAM_MAGIC    0xB2
+#define STREAM_HDR_SIZE 3
+
+#define STREAM_FLAG_START 0x01
+#define STREAM_FLAG_END   0x02
+
+static inline int stream_is_chunk(const uint8_t *data, size_t len)
+{
+	return len >= STREAM_HDR_SIZE && data[0] == STREAM_MAGIC;
+}
+
+/*
+ * Check the header of a chunk that arrived, in the order chunks arrived.
+ * Sets first and last for passing its data to stream_feed(), returns
+ * -EINVAL if the chunk is to be dropped.
+ */
+int stream_chunk_begin(const uint8_t *chunk, size_t len, bool *first, bool *last);
+
+/*
+ * Play the next piece of a payload that is known to arrive in order, a
+ * chunk or e.g. read back from flash. first and last mark its start and
+ * end. An incomplete command is carried over to the next piece.
+ *
+ * Never sleeps. Returns how much was used, the rest has to be passed again
+ * with the same last. When a command has to wait it sets wait_ms, then the
+ * rest is passed once that is over, even if there is none left.
+ */
+size_t stream_feed(const uint8_t *data, size_t size, bool first, bool last, uint32_t *wait_ms);
+
+/* Drop the payload being played, including chunks of it still to come. */
+void stream_cancel(void);
+
+#endif /* REVENGE_STREAM_H_ */
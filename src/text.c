@@ -0,0 +1,211 @@
+/**
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#include <zephyr/kernel.h>
+#include <zephyr/usb/class/usb_hid.h>
+#include <zephyr/logging/log.h>
+#include <string.h>
+#include <errno.h>
+
+#include "text.h"
+#include "hid_out.h"
+#include "kbd.h"
+#include "keymap.h"
+#include "mouse.h"
+#include "text_parse.h"
+
+LOG_MODULE_REGISTER(text);
+
+static void open_terminal();
+static void send_enter();
+static int type_text(const char *str, size_t len);
+
+/* Opening a URL is a sequence with waits, resumed by text_feed() */
+enum url_phase {
+	URL_IDLE,
+	URL_TERMINAL,
+	URL_TYPE,
+	URL_ENTER,
+};
+
+static struct {
+	enum url_phase phase;
+	/* Rotate the mouse once the URL is open */
+	bool rotate;
+	/* Kept by the parser, which has nothing left to parse until it is done */
+	const char *url;
+	size_t len;
+} url_seq;
+
+static void url_start(const char *url, size_t len, bool rotate)
+{
+	url_seq.url = url;
+	url_seq.len = len;
+	url_seq.rotate = rotate;
+	url_seq.phase = URL_TERMINAL;
+}
+
+/* Run the sequence up to its next wait, returns false once it is done */
+static bool url_step(uint32_t *wait_ms)
+{
+	switch (url_seq.phase) {
+	case URL_TERMINAL:
+		open_terminal();
+		url_seq.phase = URL_TYPE;
+		*wait_ms = TEXT_TERMINAL_DELAY_MS;
+		return true;
+	case URL_TYPE:
+		/* Typed as is, a URL has no commands in it */
+		type_text("xdg-open ", strlen("xdg-open "));
+		type_text(url_seq.url, url_seq.len);
+		kbd_release();
+		url_seq.phase = URL_ENTER;
+		*wait_ms = TEXT_URL_ENTER_DELAY_MS;
+		return true;
+	case URL_ENTER:
+		send_enter();
+		if (url_seq.rotate) {
+			mouse_rotate(TEXT_MOUSE_LONG_S);
+		}
+		url_seq.phase = URL_IDLE;
+		return false;
+	default:
+		return false;
+	}
+}
+
+/* State carries over between the pieces of a payload */
+static struct text_parser parser;
+
+static int type_text(const char *str, size_t len)
+{
+	for (size_t i = 0; i < len; i++) {
+		uint16_t key = keymap_lookup(str[i]);
+
+		if (key == 0) {
+			continue;  // Skip unsupported characters
+		}
+
+		if (kbd_type(key) < 0) {
+			return -EIO;
+		}
+	}
+
+	return 0;
+}
+
+size_t text_feed(const uint8_t *data, size_t size, bool last, uint32_t *wait_ms)
+{
+	struct text_cmd cmd;
+	size_t pos = 0;
+	size_t used;
+
+	*wait_ms = 0;
+
+	if (url_step(wait_ms)) {
+		return 0;
+	}
+
+	while (text_parse(&parser, &data[pos], size - pos, last, &used, &cmd)) {
+		pos += used;
+
+		if (cmd.op != TEXT_OP_TEXT) {
+			/* Commands pause or interleave with typing, let go of the keys */
+			kbd_release();
+		}
+
+		switch (cmd.op) {
+		case TEXT_OP_TEXT:
+			if (type_text(cmd.str, cmd.arg) < 0) {
+				text_parse_init(&parser);
+				return size;
+			}
+			break;
+		case TEXT_OP_ENTER:
+			send_enter();
+			break;
+		case TEXT_OP_TERMINAL:
+			open_terminal();
+			break;
+		case TEXT_OP_RICK_ROLL:
+			url_start(TEXT_RICK_ROLL_URL, strlen(TEXT_RICK_ROLL_URL), false);
+			url_step(wait_ms);
+			return pos;
+		case TEXT_OP_CAPSLOCK:
+			kbd_tap(0, HID_KEY_CAPSLOCK);
+			kbd_release();
+			break;
+		case TEXT_OP_PACE:
+			hid_out_set_min_interval(MIN(cmd.arg, TEXT_PACE_MAX) * USEC_PER_MSEC);
+			break;
+		case TEXT_OP_PACK:
+			if (kbd_set_keys_per_report(cmd.arg) != 0) {
+				LOG_WRN("%u keys per report not supported", cmd.arg);
+			}
+			break;
+		case TEXT_OP_LAYOUT:
+			if (keymap_select(cmd.str, cmd.arg) != 0) {
+				LOG_WRN("Layout %.*s not compiled in", (int)cmd.arg, cmd.str);
+			}
+			break;
+		case TEXT_OP_SLEEP:
+			*wait_ms = TEXT_SLEEP_MS;
+			return pos;
+		case TEXT_OP_MOUSE:
+			mouse_rotate(TEXT_MOUSE_SHORT_S);
+			break;
+		case TEXT_OP_URL:
+		case TEXT_OP_URL_MOUSE:
+			url_start(cmd.str, cmd.arg, cmd.op == TEXT_OP_URL_MOUSE);
+			url_step(wait_ms);
+			return pos;
+		case TEXT_OP_TOO_LONG:
+			LOG_ERR("%s longer than %d characters, dropped",
+				cmd.arg == TEXT_OP_LAYOUT ? "Layout name" : "URL",
+				TEXT_PARSE_STR_MAX);
+			break;
+		}
+	}
+	pos += used;
+
+	kbd_release();
+
+	return pos;
+}
+
+void text_run(const uint8_t *data, size_t size)
+{
+	uint32_t wait_ms;
+	size_t used;
+
+	text_cancel();
+
+	do {
+		used = text_feed(data, size, true, &wait_ms);
+		data += used;
+		size -= used;
+		k_sleep(K_MSEC(wait_ms));
+	} while (wait_ms > 0);
+}
+
+void text_cancel(void)
+{
+	url_seq.phase = URL_IDLE;
+	text_parse_init(&parser);
+}
+
+// ============================ special sequences ============================
+
+/* ctrl+alt+t (open terminal) */
+static void open_terminal()
+{
+	kbd_tap(HID_KBD_MODIFIER_LEFT_CTRL | HID_KBD_MODIFIER_LEFT_ALT, HID_KEY_T);
+	kbd_release();
+}
+
+static void send_enter()
+{
+	kbd_tap(0, HID_KEY_ENTER);
+	kbd_release();
+}
+
@@ -0,0 +1,31 @@
+/**
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#ifndef REVENGE_TEXT_H_
+#define REVENGE_TEXT_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Type a text payload, handling the backslash commands listed in the
+ * README. Blocks until everything has been sent, waits included.
+ */
+void text_run(const uint8_t *data, size_t size);
+
+/*
+ * Type part of a payload that arrives in pieces, last marks the final one.
+ * Pieces may be split anywhere, the parser (text_parse.h) picks up a
+ * command where the previous piece left it. Returns how many bytes were
+ * used, which is all of them unless a command has to wait.
+ *
+ * Never sleeps. A command that has to wait stops there and sets wait_ms,
+ * after which the rest, possibly nothing, has to be passed again.
+ */
+size_t text_feed(const uint8_t *data, size_t size, bool last, uint32_t *wait_ms);
+
+/* Start over with a new payload, forgetting a sequence waiting to go on. */
+void text_cancel(void);
+
+#endif /* REVENGE_TEXT_H_ */
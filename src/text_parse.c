@@ -0,0 +1,259 @@
+/**
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#include <string.h>
+
+#include "text_parse.h"
+
+#ifndef MIN
+#define MIN(a, b) ((a) < (b) ? (a) : (b))
+#endif
+
+enum state {
+	S_TEXT,
+	/* After a backslash */
+	S_ESC,
+	/* Digits of \p */
+	S_PACE,
+	/* Digit of \k */
+	S_PACK,
+	/* Name of \l */
+	S_LAYOUT,
+	/* \u and \x, up to the end of the payload */
+	S_URL,
+	S_COUNT,
+};
+
+enum class {
+	C_OTHER,
+	C_BACKSLASH,
+	C_DIGIT,
+	C_ALPHA,
+	C_SPACE,
+	C_COUNT,
+};
+
+enum action {
+	/* Pass on the run of plain text starting here */
+	A_TEXT,
+	/* Consume the byte */
+	A_SKIP,
+	/* Look the byte up in escapes[] */
+	A_ESCAPE,
+	/* Add a digit to num */
+	A_DIGIT,
+	/* Emit \p, the byte is not part of it */
+	A_PACE,
+	/* Emit \k with this digit */
+	A_PACK,
+	/* Go on in S_TEXT with the byte */
+	A_AGAIN,
+	/* Add the byte to str */
+	A_STR,
+	/* Emit \l, with or without the space ending it */
+	A_LAYOUT,
+	A_LAYOUT_SPACE,
+};
+
+struct transition {
+	uint8_t next;
+	uint8_t action;
+};
+
+static const uint8_t classes[256] = {
+	['\\'] = C_BACKSLASH,
+	['0' ... '9'] = C_DIGIT,
+	['A' ... 'Z'] = C_ALPHA,
+	['a' ... 'z'] = C_ALPHA,
+	[' '] = C_SPACE,
+};
+
+static const struct transition transitions[S_COUNT][C_COUNT] = {
+	[S_TEXT] = {
+		[C_OTHER] = { S_TEXT, A_TEXT },
+		[C_BACKSLASH] = { S_ESC, A_SKIP },
+		[C_DIGIT] = { S_TEXT, A_TEXT },
+		[C_ALPHA] = { S_TEXT, A_TEXT },
+		[C_SPACE] = { S_TEXT, A_TEXT },
+	},
+	[S_ESC] = {
+		[C_OTHER] = { S_TEXT, A_ESCAPE },
+		[C_BACKSLASH] = { S_TEXT, A_ESCAPE },
+		[C_DIGIT] = { S_TEXT, A_ESCAPE },
+		[C_ALPHA] = { S_TEXT, A_ESCAPE },
+		[C_SPACE] = { S_TEXT, A_ESCAPE },
+	},
+	[S_PACE] = {
+		[C_OTHER] = { S_TEXT, A_PACE },
+		[C_BACKSLASH] = { S_TEXT, A_PACE },
+		[C_DIGIT] = { S_PACE, A_DIGIT },
+		[C_ALPHA] = { S_TEXT, A_PACE },
+		[C_SPACE] = { S_TEXT, A_PACE },
+	},
+	[S_PACK] = {
+		[C_OTHER] = { S_TEXT, A_AGAIN },
+		[C_BACKSLASH] = { S_TEXT, A_AGAIN },
+		[C_DIGIT] = { S_TEXT, A_PACK },
+		[C_ALPHA] = { S_TEXT, A_AGAIN },
+		[C_SPACE] = { S_TEXT, A_AGAIN },
+	},
+	[S_LAYOUT] = {
+		[C_OTHER] = { S_TEXT, A_LAYOUT },
+		[C_BACKSLASH] = { S_TEXT, A_LAYOUT },
+		[C_DIGIT] = { S_LAYOUT, A_STR },
+		[C_ALPHA] = { S_LAYOUT, A_STR },
+		[C_SPACE] = { S_TEXT, A_LAYOUT_SPACE },
+	},
+	[S_URL] = {
+		[C_OTHER] = { S_URL, A_STR },
+		[C_BACKSLASH] = { S_URL, A_STR },
+		[C_DIGIT] = { S_URL, A_STR },
+		[C_ALPHA] = { S_URL, A_STR },
+		[C_SPACE] = { S_URL, A_STR },
+	},
+};
+
+/* What the letter after a backslash does, unknown ones drop the backslash */
+struct escape {
+	uint8_t known;
+	uint8_t next;
+	uint8_t op;
+};
+
+static const struct escape escapes[128] = {
+	['n'] = { 1, S_TEXT, TEXT_OP_ENTER },
+	['t'] = { 1, S_TEXT, TEXT_OP_TERMINAL },
+	['r'] = { 1, S_TEXT, TEXT_OP_RICK_ROLL },
+	['c'] = { 1, S_TEXT, TEXT_OP_CAPSLOCK },
+	['s'] = { 1, S_TEXT, TEXT_OP_SLEEP },
+	['m'] = { 1, S_TEXT, TEXT_OP_MOUSE },
+	['p'] = { 1, S_PACE, TEXT_OP_PACE },
+	['k'] = { 1, S_PACK, TEXT_OP_PACK },
+	['l'] = { 1, S_LAYOUT, TEXT_OP_LAYOUT },
+	['u'] = { 1, S_URL, TEXT_OP_URL },
+	['x'] = { 1, S_URL, TEXT_OP_URL_MOUSE },
+};
+
+void text_parse_init(struct text_parser *p)
+{
+	p->state = S_TEXT;
+	p->len = 0;
+	p->num = 0;
+}
+
+static bool emit(struct text_cmd *cmd, enum text_op op, uint32_t arg, const char *str)
+{
+	cmd->op = op;
+	cmd->arg = arg;
+	cmd->str = str;
+
+	return true;
+}
+
+/* A layout name or URL, unless it did not fit */
+static bool emit_str(struct text_parser *p, struct text_cmd *cmd)
+{
+	if (p->len > sizeof(p->str)) {
+		return emit(cmd, TEXT_OP_TOO_LONG, p->op, NULL);
+	}
+
+	return emit(cmd, p->op, p->len, p->str);
+}
+
+/* Complete what is open at the end of the payload */
+static bool finish(struct text_parser *p, struct text_cmd *cmd)
+{
+	enum state state = p->state;
+
+	p->state = S_TEXT;
+
+	switch (state) {
+	case S_ESC:
+		/* Nothing follows, the backslash is typed */
+		return emit(cmd, TEXT_OP_TEXT, 1, "\\");
+	case S_PACE:
+		return emit(cmd, TEXT_OP_PACE, p->num, NULL);
+	case S_LAYOUT:
+	case S_URL:
+		return emit_str(p, cmd);
+	default:
+		return false;
+	}
+}
+
+bool text_parse(struct text_parser *p, const uint8_t *data, size_t size, bool last,
+		size_t *used, struct text_cmd *cmd)
+{
+	size_t i = 0;
+
+	while (i < size) {
+		uint8_t c = data[i];
+		const struct transition *t = &transitions[p->state][classes[c]];
+		const struct escape *e;
+		size_t start;
+		size_t n;
+
+		p->state = t->next;
+
+		switch (t->action) {
+		case A_TEXT:
+			start = i;
+			while (i < size && classes[data[i]] != C_BACKSLASH) {
+				i++;
+			}
+			*used = i;
+			return emit(cmd, TEXT_OP_TEXT, i - start, (const char *)&data[start]);
+		case A_SKIP:
+			i++;
+			break;
+		case A_ESCAPE:
+			e = c < sizeof(escapes) / sizeof(escapes[0]) ? &escapes[c] : &escapes[0];
+			if (!e->known) {
+				/* Typed as plain text */
+				break;
+			}
+			i++;
+			p->state = e->next;
+			p->op = e->op;
+			p->num = 0;
+			p->len = 0;
+			if (e->next == S_TEXT) {
+				*used = i;
+				return emit(cmd, e->op, 0, NULL);
+			}
+			break;
+		case A_DIGIT:
+			p->num = MIN(p->num * 10 + (c - '0'), TEXT_PACE_MAX);
+			i++;
+			break;
+		case A_PACE:
+			*used = i;
+			return emit(cmd, TEXT_OP_PACE, p->num, NULL);
+		case A_PACK:
+			*used = i + 1;
+			return emit(cmd, TEXT_OP_PACK, c - '0', NULL);
+		case A_AGAIN:
+			break;
+		case A_STR:
+			/* A URL takes everything up to the end, copied in one go */
+			n = p->state == S_URL ? size - i : 1;
+			if (p->len < sizeof(p->str)) {
+				memcpy(&p->str[p->len], &data[i], MIN(n, sizeof(p->str) - p->len));
+			}
+			/* Counted on, so a string that did not fit is rejected */
+			p->len += n;
+			i += n;
+			break;
+		case A_LAYOUT_SPACE:
+			i++;
+			/* fall through */
+		case A_LAYOUT:
+			*used = i;
+			return emit_str(p, cmd);
+		}
+	}
+
+	*used = i;
+
+	return last && finish(p, cmd);
+}
@@ -0,0 +1,90 @@
+/**
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#ifndef REVENGE_TEXT_PARSE_H_
+#define REVENGE_TEXT_PARSE_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Incremental parser for text payloads.
+ *
+ * Turns the text and its backslash commands into a stream of commands in a
+ * single pass. Its state carries over from one call to the next, so a
+ * payload can be split anywhere, even inside a command, without anything
+ * being held back or scanned twice. Plain text is passed on in place.
+ *
+ * This header is free of Zephyr dependencies, so the parser can be run and
+ * measured on its own.
+ */
+
+enum text_op {
+	/* str[arg] typed as is, points into the input */
+	TEXT_OP_TEXT,
+	TEXT_OP_ENTER,
+	TEXT_OP_TERMINAL,
+	TEXT_OP_RICK_ROLL,
+	TEXT_OP_CAPSLOCK,
+	/* arg ms between reports, up to TEXT_PACE_MAX */
+	TEXT_OP_PACE,
+	/* arg keys per report */
+	TEXT_OP_PACK,
+	/* str[arg] layout name */
+	TEXT_OP_LAYOUT,
+	TEXT_OP_SLEEP,
+	TEXT_OP_MOUSE,
+	/* str[arg] URL, TEXT_OP_URL_MOUSE rotates the mouse after it */
+	TEXT_OP_URL,
+	TEXT_OP_URL_MOUSE,
+	/* A layout name or URL over TEXT_PARSE_STR_MAX, arg its op, not run */
+	TEXT_OP_TOO_LONG,
+};
+
+struct text_cmd {
+	enum text_op op;
+	uint32_t arg;
+	/* Valid until the next call */
+	const char *str;
+};
+
+/*
+ * What the commands run on the device, which the host-side compiler turns
+ * into the same keys and delays.
+ */
+#define TEXT_RICK_ROLL_URL      "https://www.youtube.com/watch?v=xvFZjo5PgG0"
+#define TEXT_TERMINAL_DELAY_MS  1500
+#define TEXT_URL_ENTER_DELAY_MS 10
+#define TEXT_SLEEP_MS           1000
+#define TEXT_MOUSE_SHORT_S      10
+#define TEXT_MOUSE_LONG_S       60
+
+/* Longer \p values stop there, like the u16 bytecode operand */
+#define TEXT_PACE_MAX 0xFFFF
+
+/* Longest layout name or URL, longer ones are rejected */
+#define TEXT_PARSE_STR_MAX 255
+
+struct text_parser {
+	uint8_t state;
+	/* Command the collected string belongs to */
+	uint8_t op;
+	uint32_t num;
+	/* Length of the string, str holds up to TEXT_PARSE_STR_MAX of it */
+	size_t len;
+	char str[TEXT_PARSE_STR_MAX];
+};
+
+void text_parse_init(struct text_parser *p);
+
+/*
+ * Parse up to the next command. Returns true with cmd set once there is
+ * one, used tells how much of the input was consumed either way and the
+ * rest is passed again. With last set, a command still open at the end of
+ * the input is completed, e.g. a URL.
+ */
+bool text_parse(struct text_parser *p, const uint8_t *data, size_t size, bool last,
+		size_t *used, struct text_cmd *cmd);
+
+#endif /* REVENGE_TEXT_PARSE_H_ */
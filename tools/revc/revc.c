@@ -0,0 +1,1338 @@
+/**
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * revc - compile a payload script into the device bytecode (src/bytecode.h).
+ *
+ * The script is line based:
+ *
+ *   # comment
+ *   STRING text      type text, backslash commands work as on the device
+ *   STRINGLN text    type text then press enter
+ *   KEY [mods] key   press a combination, e.g. KEY CTRL ALT t or KEY GUI
+ *                    (mods: CTRL SHIFT ALT GUI ALTGR, key: a character or
+ *                    ENTER ESC TAB SPACE BACKSPACE DELETE CAPSLOCK INSERT
+ *                    HOME END PAGEUP PAGEDOWN UP DOWN LEFT RIGHT F1-F12)
+ *   ENTER, TAB, ...  shorthand for KEY with a single named key
+ *   DELAY ms         pause
+ *   MOUSE dx dy [LEFT|RIGHT|MIDDLE]
+ *   MOVETO x y [button]
+ *                    move the mouse to a point from the origin
+ *   HOME             push the mouse into the top left corner, the origin
+ *   ARC cx cy degrees [button]
+ *                    move around a centre relative to the mouse, clockwise
+ *                    for positive degrees
+ *   CURVE x1 y1 x2 y2 x y [button]
+ *                    move along a Bezier curve, points relative to the mouse
+ *   ROTATE seconds   move the mouse in circles, in the background
+ *   TERMINAL         open a terminal (ctrl+alt+t)
+ *   URL url          open a terminal and xdg-open url
+ *   LAYOUT name      translate the following text for another layout
+ *   PACE ms          minimum time between HID reports on the device
+ *   PACK n           new keys per keyboard report on the device, 1-6 or
+ *                    up to 16 with -n
+ *   REPEAT n         repeat the lines up to the matching END n times
+ *   END
+ *
+ * Text is translated to keys for the layout here, so the device only
+ * replays key codes. Runs of identical keys or lines are folded into
+ * repeat blocks. The payload size and an estimate of the time it takes to
+ * play are printed on stderr.
+ *
+ * Payloads larger than a single write are split into stream chunks
+ * (src/stream.h) with -c, printed one per line with -x. With -s the payload
+ * is wrapped in a payload cache store command (src/cache.h), the command
+ * that plays it from the cache is printed on stderr. -z compresses the
+ * payload (src/lz.h) first, which also keeps it compressed in the cache.
+ */
+#include <ctype.h>
+#include <errno.h>
+#include <getopt.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "bytecode.h"
+#include "cache.h"
+#include "keymap.h"
+#include "lz.h"
+#include "path.h"
+#include "stream.h"
+#include "text_parse.h"
+
+#define MIN(a, b) ((a) < (b) ? (a) : (b))
+
+#define MAX_LINE        1024
+#define MAX_FOLD_PERIOD 32
+#define MAX_FOLD_WINDOW 4
+#define KBD_BOOT_SLOTS  6
+/* New keys per report with CONFIG_REVENGE_KBD_NKRO, see src/kbd.c */
+#define KBD_NKRO_MAX_KEYS 16
+/* Largest single write the device accepts (UART_BUF_SIZE) */
+#define DEVICE_WRITE_MAX 500
+
+#define MOD_LCTRL  0x01
+#define MOD_LSHIFT 0x02
+#define MOD_LALT   0x04
+#define MOD_LGUI   0x08
+#define MOD_RALT   0x40
+
+#define USAGE_T         0x17
+#define USAGE_ENTER     0x28
+#define USAGE_CAPSLOCK  0x39
+
+#define DEFAULT_LAYOUT "us"
+
+/* Pointer travel of HOME, see src/mouse.c */
+#define MOUSE_HOME_TRAVEL 8192
+
+struct buf {
+	uint8_t *data;
+	size_t len;
+	size_t cap;
+};
+
+/* A single encoded instruction */
+struct op {
+	struct buf code;
+	/* REPEAT levels nested inside, which the device limits */
+	int depth;
+};
+
+struct ops {
+	struct op *v;
+	size_t n;
+	size_t cap;
+};
+
+struct parser {
+	FILE *in;
+	const char *path;
+	int lineno;
+	const uint16_t *map;
+	/* Largest PACK the device accepts */
+	long max_pack;
+};
+
+static const struct {
+	const char *name;
+	uint8_t usage;
+} named_keys[] = {
+	{ "ENTER", 0x28 }, { "ESC", 0x29 }, { "ESCAPE", 0x29 },
+	{ "BACKSPACE", 0x2A }, { "TAB", 0x2B }, { "SPACE", 0x2C },
+	{ "CAPSLOCK", 0x39 }, { "F1", 0x3A }, { "F2", 0x3B }, { "F3", 0x3C },
+	{ "F4", 0x3D }, { "F5", 0x3E }, { "F6", 0x3F }, { "F7", 0x40 },
+	{ "F8", 0x41 }, { "F9", 0x42 }, { "F10", 0x43 }, { "F11", 0x44 },
+	{ "F12", 0x45 }, { "PRINTSCREEN", 0x46 }, { "INSERT", 0x49 },
+	{ "HOME", 0x4A }, { "PAGEUP", 0x4B }, { "DELETE", 0x4C }, { "END", 0x4D },
+	{ "PAGEDOWN", 0x4E }, { "RIGHT", 0x4F }, { "LEFT", 0x50 },
+	{ "DOWN", 0x51 }, { "UP", 0x52 },
+};
+
+static const struct {
+	const char *name;
+	uint8_t mod;
+} named_mods[] = {
+	{ "CTRL", MOD_LCTRL }, { "SHIFT", MOD_LSHIFT }, { "ALT", MOD_LALT },
+	{ "GUI", MOD_LGUI }, { "ALTGR", MOD_RALT },
+};
+
+static void die(const struct parser *p, const char *fmt, ...)
+{
+	va_list ap;
+
+	if (p != NULL) {
+		fprintf(stderr, "%s:%d: ", p->path, p->lineno);
+	}
+	va_start(ap, fmt);
+	vfprintf(stderr, fmt, ap);
+	va_end(ap);
+	fputc('\n', stderr);
+	exit(EXIT_FAILURE);
+}
+
+/* ============================ buffers ============================ */
+
+static void buf_put(struct buf *b, const void *data, size_t len)
+{
+	if (b->len + len > b->cap) {
+		b->cap = (b->len + len) * 2;
+		b->data = realloc(b->data, b->cap);
+		if (b->data == NULL) {
+			die(NULL, "out of memory");
+		}
+	}
+	memcpy(&b->data[b->len], data, len);
+	b->len += len;
+}
+
+static void buf_u8(struct buf *b, uint8_t v)
+{
+	buf_put(b, &v, 1);
+}
+
+static void buf_le16(struct buf *b, uint16_t v)
+{
+	uint8_t le[2] = { v & 0xFF, v >> 8 };
+
+	buf_put(b, le, sizeof(le));
+}
+
+static void ops_push(struct ops *ops, struct op op)
+{
+	if (ops->n == ops->cap) {
+		ops->cap = ops->cap ? ops->cap * 2 : 16;
+		ops->v = realloc(ops->v, ops->cap * sizeof(*ops->v));
+		if (ops->v == NULL) {
+			die(NULL, "out of memory");
+		}
+	}
+	ops->v[ops->n++] = op;
+}
+
+static void ops_free(struct ops *ops)
+{
+	for (size_t i = 0; i < ops->n; i++) {
+		free(ops->v[i].code.data);
+	}
+	free(ops->v);
+	memset(ops, 0, sizeof(*ops));
+}
+
+static bool op_equal(const struct op *a, const struct op *b)
+{
+	return a->code.len == b->code.len &&
+	       memcmp(a->code.data, b->code.data, a->code.len) == 0;
+}
+
+/* ============================ emitters ============================ */
+
+static void emit_keys(struct ops *ops, const uint8_t *pairs, size_t n)
+{
+	while (n > 0) {
+		size_t chunk = n > UINT8_MAX ? UINT8_MAX : n;
+		struct op op = { 0 };
+
+		buf_u8(&op.code, BC_OP_KEYS);
+		buf_u8(&op.code, chunk);
+		buf_put(&op.code, pairs, 2 * chunk);
+		ops_push(ops, op);
+		pairs += 2 * chunk;
+		n -= chunk;
+	}
+}
+
+static void emit_key(struct ops *ops, uint8_t mods, uint8_t usage)
+{
+	uint8_t pair[2] = { mods, usage };
+
+	emit_keys(ops, pair, 1);
+}
+
+static void emit_combo(struct ops *ops, uint8_t mods, uint8_t usage)
+{
+	struct op op = { 0 };
+
+	buf_u8(&op.code, BC_OP_COMBO);
+	buf_u8(&op.code, mods);
+	buf_u8(&op.code, usage);
+	ops_push(ops, op);
+}
+
+static void emit_u8(struct ops *ops, enum bc_op code, uint8_t v)
+{
+	struct op op = { 0 };
+
+	buf_u8(&op.code, code);
+	buf_u8(&op.code, v);
+	ops_push(ops, op);
+}
+
+static void emit_u16(struct ops *ops, enum bc_op code, uint16_t v)
+{
+	struct op op = { 0 };
+
+	buf_u8(&op.code, code);
+	buf_le16(&op.code, v);
+	ops_push(ops, op);
+}
+
+static void emit_delay(struct ops *ops, unsigned long ms)
+{
+	while (ms > 0) {
+		uint16_t chunk = ms > UINT16_MAX ? UINT16_MAX : ms;
+
+		emit_u16(ops, BC_OP_DELAY, chunk);
+		ms -= chunk;
+	}
+}
+
+static void emit_mouse(struct ops *ops, uint8_t buttons, int16_t dx, int16_t dy)
+{
+	struct op op = { 0 };
+
+	buf_u8(&op.code, BC_OP_MOUSE);
+	buf_u8(&op.code, buttons);
+	buf_le16(&op.code, (uint16_t)dx);
+	buf_le16(&op.code, (uint16_t)dy);
+	ops_push(ops, op);
+}
+
+/* A pointer path, buttons then n coordinates */
+static void emit_path(struct ops *ops, enum bc_op code, uint8_t buttons, const long *v, int n)
+{
+	struct op op = { 0 };
+
+	buf_u8(&op.code, code);
+	buf_u8(&op.code, buttons);
+	for (int i = 0; i < n; i++) {
+		buf_le16(&op.code, (uint16_t)v[i]);
+	}
+	ops_push(ops, op);
+}
+
+static int ops_depth(const struct ops *ops, size_t from, size_t to)
+{
+	int depth = 0;
+
+	for (size_t i = from; i < to; i++) {
+		depth = ops->v[i].depth > depth ? ops->v[i].depth : depth;
+	}
+
+	return depth;
+}
+
+static void emit_repeat(struct ops *ops, uint8_t count, const struct buf *body, int body_depth)
+{
+	struct op op = { .depth = body_depth + 1 };
+
+	buf_u8(&op.code, BC_OP_REPEAT);
+	buf_u8(&op.code, count);
+	buf_le16(&op.code, body->len);
+	buf_put(&op.code, body->data, body->len);
+	ops_push(ops, op);
+}
+
+static void serialize(const struct ops *ops, size_t from, size_t to, struct buf *out)
+{
+	for (size_t i = from; i < to; i++) {
+		buf_put(out, ops->v[i].code.data, ops->v[i].code.len);
+	}
+}
+
+/* Translate text to key pairs, dead keys get a space to complete them */
+static void emit_text(const struct parser *p, struct ops *ops, const char *text, size_t len)
+{
+	uint8_t *pairs = malloc(4 * len + 1);
+	size_t n = 0;
+
+	for (size_t i = 0; i < len; i++) {
+		uint8_t c = text[i];
+		uint16_t key = c < KEYMAP_SIZE ? p->map[c] : 0;
+
+		if (key == 0) {
+			die(p, "character 0x%02x cannot be typed on this layout", c);
+		}
+		pairs[2 * n] = KEYMAP_MODS(key);
+		pairs[2 * n + 1] = KEYMAP_USAGE(key);
+		n++;
+		if (KEYMAP_IS_DEAD(key)) {
+			uint16_t space = p->map[' '];
+
+			pairs[2 * n] = KEYMAP_MODS(space);
+			pairs[2 * n + 1] = KEYMAP_USAGE(space);
+			n++;
+		}
+	}
+	emit_keys(ops, pairs, n);
+	free(pairs);
+}
+
+/* The sequence of url_step() in src/text.c */
+static void emit_url(const struct parser *p, struct ops *ops, const char *url, size_t len)
+{
+	static const char cmd[] = "xdg-open ";
+
+	emit_combo(ops, MOD_LCTRL | MOD_LALT, USAGE_T);
+	emit_delay(ops, TEXT_TERMINAL_DELAY_MS);
+	emit_text(p, ops, cmd, strlen(cmd));
+	emit_text(p, ops, url, len);
+	emit_delay(ops, TEXT_URL_ENTER_DELAY_MS);
+	emit_key(ops, 0, USAGE_ENTER);
+}
+
+/* ============================ optimizer ============================ */
+
+/* Join neighbouring KEYS and DELAY instructions */
+static void merge_adjacent(struct ops *ops)
+{
+	struct ops out = { 0 };
+
+	for (size_t i = 0; i < ops->n; i++) {
+		struct op *cur = &ops->v[i];
+		struct op *prev = out.n ? &out.v[out.n - 1] : NULL;
+
+		if (prev && prev->code.data[0] == BC_OP_KEYS && cur->code.data[0] == BC_OP_KEYS &&
+		    prev->code.data[1] + cur->code.data[1] <= UINT8_MAX) {
+			prev->code.data[1] += cur->code.data[1];
+			buf_put(&prev->code, &cur->code.data[2], cur->code.len - 2);
+			free(cur->code.data);
+			continue;
+		}
+		if (prev && prev->code.data[0] == BC_OP_DELAY && cur->code.data[0] == BC_OP_DELAY) {
+			unsigned int sum = (prev->code.data[1] | prev->code.data[2] << 8) +
+					   (cur->code.data[1] | cur->code.data[2] << 8);
+
+			if (sum <= UINT16_MAX) {
+				prev->code.data[1] = sum & 0xFF;
+				prev->code.data[2] = sum >> 8;
+				free(cur->code.data);
+				continue;
+			}
+		}
+		ops_push(&out, *cur);
+	}
+
+	free(ops->v);
+	*ops = out;
+}
+
+/* Find how often the unit at pairs[0..period) repeats back to back */
+static size_t count_repeats(const uint8_t *pairs, size_t n, size_t period)
+{
+	size_t k = 1;
+
+	while ((k + 1) * period <= n &&
+	       memcmp(pairs, &pairs[2 * k * period], 2 * period) == 0 && k < UINT8_MAX) {
+		k++;
+	}
+
+	return k;
+}
+
+/*
+ * Fold periodic runs inside KEYS instructions into repeat blocks, unless
+ * max_depth REPEAT levels are already used around them.
+ */
+static void fold_keys(struct ops *ops, int max_depth)
+{
+	struct ops out = { 0 };
+
+	for (size_t i = 0; i < ops->n; i++) {
+		struct op *op = &ops->v[i];
+		const uint8_t *pairs = &op->code.data[2];
+		size_t n = op->code.data[1];
+		size_t start = 0;
+		size_t j = 0;
+
+		if (op->code.data[0] != BC_OP_KEYS || max_depth < 1) {
+			ops_push(&out, *op);
+			continue;
+		}
+
+		while (j < n) {
+			size_t best_period = 0;
+			size_t best_k = 0;
+			long best_saving = 0;
+
+			for (size_t period = 1; period <= MAX_FOLD_PERIOD && period <= n - j; period++) {
+				size_t k = count_repeats(&pairs[2 * j], n - j, period);
+				/* REPEAT header + KEYS header vs the unrolled pairs */
+				long saving = (long)(2 * period * k) - (long)(4 + 2 + 2 * period);
+
+				if (k >= 2 && saving > best_saving) {
+					best_period = period;
+					best_k = k;
+					best_saving = saving;
+				}
+			}
+
+			if (best_saving <= 0) {
+				j++;
+				continue;
+			}
+
+			struct ops unit = { 0 };
+			struct buf body = { 0 };
+
+			emit_keys(&out, &pairs[2 * start], j - start);
+			emit_keys(&unit, &pairs[2 * j], best_period);
+			serialize(&unit, 0, unit.n, &body);
+			emit_repeat(&out, best_k, &body, 0);
+			ops_free(&unit);
+			free(body.data);
+
+			j += best_period * best_k;
+			start = j;
+		}
+		emit_keys(&out, &pairs[2 * start], n - start);
+		free(op->code.data);
+	}
+
+	free(ops->v);
+	*ops = out;
+}
+
+/*
+ * Fold back to back identical runs of instructions into repeat blocks, as
+ * long as they nest at most max_depth deep.
+ */
+static void fold_ops(struct ops *ops, int max_depth)
+{
+	struct ops out = { 0 };
+	size_t i = 0;
+
+	while (i < ops->n) {
+		size_t best_w = 0;
+		size_t best_k = 0;
+		long best_saving = 0;
+
+		for (size_t w = 1; w <= MAX_FOLD_WINDOW && i + w <= ops->n; w++) {
+			size_t k = 1;
+			size_t size = 0;
+
+			if (ops_depth(ops, i, i + w) + 1 > max_depth) {
+				continue;
+			}
+
+			for (size_t m = 0; m < w; m++) {
+				size += ops->v[i + m].code.len;
+			}
+			while (i + (k + 1) * w <= ops->n && k < UINT8_MAX) {
+				bool same = true;
+
+				for (size_t m = 0; m < w && same; m++) {
+					same = op_equal(&ops->v[i + m], &ops->v[i + k * w + m]);
+				}
+				if (!same) {
+					break;
+				}
+				k++;
+			}
+
+			long saving = (long)(size * k) - (long)(4 + size);
+
+			if (k >= 2 && saving > best_saving) {
+				best_w = w;
+				best_k = k;
+				best_saving = saving;
+			}
+		}
+
+		if (best_saving <= 0) {
+			ops_push(&out, ops->v[i++]);
+			continue;
+		}
+
+		struct buf body = { 0 };
+
+		serialize(ops, i, i + best_w, &body);
+		emit_repeat(&out, best_k, &body, ops_depth(ops, i, i + best_w));
+		free(body.data);
+		for (size_t m = i; m < i + best_w * best_k; m++) {
+			free(ops->v[m].code.data);
+		}
+		i += best_w * best_k;
+	}
+
+	free(ops->v);
+	*ops = out;
+}
+
+/* Instructions end up inside depth REPEAT blocks of the script */
+static void optimize(struct ops *ops, int depth)
+{
+	merge_adjacent(ops);
+	fold_keys(ops, BC_MAX_DEPTH - depth);
+	fold_ops(ops, BC_MAX_DEPTH - depth);
+}
+
+/* ============================ parser ============================ */
+
+static const struct keymap_layout *find_layout(const char *name)
+{
+	for (size_t i = 0; i < keymap_layout_count; i++) {
+		if (strcmp(keymap_layouts[i].name, name) == 0) {
+			return &keymap_layouts[i];
+		}
+	}
+
+	return NULL;
+}
+
+static long parse_number(const struct parser *p, const char *s, long min, long max)
+{
+	char *end;
+	long v;
+
+	errno = 0;
+	v = strtol(s, &end, 0);
+	if (errno || end == s || (*end != '\0' && !isspace((unsigned char)*end)) ||
+	    v < min || v > max) {
+		die(p, "expected a number from %ld to %ld, got '%s'", min, max, s);
+	}
+
+	return v;
+}
+
+static bool named_key(const char *name, uint8_t *usage)
+{
+	for (size_t i = 0; i < sizeof(named_keys) / sizeof(named_keys[0]); i++) {
+		if (strcmp(named_keys[i].name, name) == 0) {
+			*usage = named_keys[i].usage;
+			return true;
+		}
+	}
+
+	return false;
+}
+
+static uint8_t parse_button(const struct parser *p, const char *btn)
+{
+	uint8_t buttons = strcmp(btn, "LEFT") == 0 ? 0x01 :
+			  strcmp(btn, "RIGHT") == 0 ? 0x02 :
+			  strcmp(btn, "MIDDLE") == 0 ? 0x04 : 0;
+
+	if (buttons == 0) {
+		die(p, "unknown button '%s'", btn);
+	}
+
+	return buttons;
+}
+
+/* n coordinates and an optional button */
+static uint8_t parse_coords(const struct parser *p, const char *cmd, char *args, long *v, int n)
+{
+	char *tok = strtok(args, " \t");
+
+	for (int i = 0; i < n; i++, tok = strtok(NULL, " \t")) {
+		if (tok == NULL) {
+			die(p, "%s needs %d numbers", cmd, n);
+		}
+		v[i] = parse_number(p, tok, INT16_MIN, INT16_MAX);
+	}
+
+	return tok != NULL ? parse_button(p, tok) : 0;
+}
+
+/* Text with the device's backslash commands, see text_feed() and src/text_parse.c */
+static void parse_text(struct parser *p, struct ops *ops, const char *s)
+{
+	size_t len = strlen(s);
+	size_t start = 0;
+
+	for (size_t i = 0; i < len; i++) {
+		if (s[i] != '\\' || i == len - 1) {
+			continue;
+		}
+
+		emit_text(p, ops, &s[start], i - start);
+		i++;
+
+		switch (s[i]) {
+		case 'n':
+			emit_key(ops, 0, USAGE_ENTER);
+			break;
+		case 't':
+			emit_combo(ops, MOD_LCTRL | MOD_LALT, USAGE_T);
+			break;
+		case 'r':
+			emit_url(p, ops, TEXT_RICK_ROLL_URL, strlen(TEXT_RICK_ROLL_URL));
+			break;
+		case 'c':
+			emit_combo(ops, 0, USAGE_CAPSLOCK);
+			break;
+		case 's':
+			emit_delay(ops, TEXT_SLEEP_MS);
+			break;
+		case 'm':
+			emit_u8(ops, BC_OP_ROTATE, TEXT_MOUSE_SHORT_S);
+			break;
+		case 'p': {
+			unsigned long ms = 0;
+
+			while (isdigit((unsigned char)s[i + 1])) {
+				ms = ms * 10 + (s[++i] - '0');
+			}
+			if (ms > UINT16_MAX) {
+				die(p, "pace %lu ms out of range", ms);
+			}
+			emit_u16(ops, BC_OP_PACE, ms);
+			break;
+		}
+		case 'k': {
+			long n;
+
+			if (!isdigit((unsigned char)s[i + 1])) {
+				die(p, "\\k needs a digit");
+			}
+			n = s[++i] - '0';
+			if (n < 1 || n > p->max_pack) {
+				die(p, "\\k%ld out of range 1-%ld", n, p->max_pack);
+			}
+			emit_u8(ops, BC_OP_PACK, n);
+			break;
+		}
+		case 'l': {
+			char name[32];
+			size_t n = 0;
+			const struct keymap_layout *layout;
+
+			while (isalnum((unsigned char)s[i + 1]) && n < sizeof(name) - 1) {
+				name[n++] = s[++i];
+			}
+			name[n] = '\0';
+			layout = find_layout(name);
+			if (layout == NULL) {
+				die(p, "unknown layout '%s'", name);
+			}
+			p->map = layout->map;
+			if (s[i + 1] == ' ') {
+				i++;
+			}
+			break;
+		}
+		case 'u':
+		case 'x':
+			/* The URL runs to the end of the text */
+			emit_url(p, ops, &s[i + 1], len - i - 1);
+			if (s[i] == 'x') {
+				emit_u8(ops, BC_OP_ROTATE, TEXT_MOUSE_LONG_S);
+			}
+			return;
+		default:
+			/* Unknown commands drop the backslash, like the device */
+			i--;
+			break;
+		}
+		start = i + 1;
+	}
+
+	emit_text(p, ops, &s[start], len - start);
+}
+
+static void parse_key(const struct parser *p, struct ops *ops, char *args)
+{
+	uint8_t mods = 0;
+	uint8_t usage = 0;
+	char *tok;
+
+	for (tok = strtok(args, " \t"); tok != NULL; tok = strtok(NULL, " \t")) {
+		bool found = false;
+
+		for (size_t i = 0; i < sizeof(named_mods) / sizeof(named_mods[0]); i++) {
+			if (strcmp(named_mods[i].name, tok) == 0) {
+				mods |= named_mods[i].mod;
+				found = true;
+			}
+		}
+		if (found) {
+			continue;
+		}
+		if (usage != 0) {
+			die(p, "only one non-modifier key per combination");
+		}
+		if (named_key(tok, &usage)) {
+			continue;
+		}
+		if (strlen(tok) == 1 && (uint8_t)tok[0] < KEYMAP_SIZE && p->map[(uint8_t)tok[0]]) {
+			uint16_t key = p->map[(uint8_t)tok[0]];
+
+			mods |= KEYMAP_MODS(key);
+			usage = KEYMAP_USAGE(key);
+			continue;
+		}
+		die(p, "unknown key '%s'", tok);
+	}
+
+	emit_combo(ops, mods, usage);
+}
+
+/* Parse lines until END (nested) or end of file (top level) */
+static void parse_block(struct parser *p, struct ops *ops, int depth)
+{
+	char line[MAX_LINE];
+
+	while (fgets(line, sizeof(line), p->in) != NULL) {
+		size_t len = strlen(line);
+		char *cmd = line;
+		char *args;
+		uint8_t usage;
+
+		p->lineno++;
+		if (len == sizeof(line) - 1 && line[len - 1] != '\n') {
+			die(p, "line too long");
+		}
+		while (len > 0 && (line[len - 1] == '\n' || line[len - 1] == '\r')) {
+			line[--len] = '\0';
+		}
+		while (isspace((unsigned char)*cmd)) {
+			cmd++;
+		}
+		if (*cmd == '\0' || *cmd == '#') {
+			continue;
+		}
+
+		/* Split the command word off, STRING keeps its argument verbatim */
+		args = cmd;
+		while (*args != '\0' && !isspace((unsigned char)*args)) {
+			args++;
+		}
+		if (*args != '\0') {
+			*args++ = '\0';
+		}
+
+		if (strcmp(cmd, "STRING") == 0) {
+			parse_text(p, ops, args);
+		} else if (strcmp(cmd, "STRINGLN") == 0) {
+			parse_text(p, ops, args);
+			emit_key(ops, 0, USAGE_ENTER);
+		} else if (strcmp(cmd, "KEY") == 0) {
+			parse_key(p, ops, args);
+		} else if (strcmp(cmd, "DELAY") == 0) {
+			emit_delay(ops, parse_number(p, args, 0, 24L * 3600 * 1000));
+		} else if (strcmp(cmd, "MOUSE") == 0) {
+			long v[2];
+			uint8_t buttons = parse_coords(p, cmd, args, v, 2);
+
+			emit_mouse(ops, buttons, v[0], v[1]);
+		} else if (strcmp(cmd, "MOVETO") == 0) {
+			long v[2];
+			uint8_t buttons = parse_coords(p, cmd, args, v, 2);
+
+			emit_path(ops, BC_OP_MOVETO, buttons, v, 2);
+		} else if (strcmp(cmd, "HOME") == 0) {
+			struct op op = { 0 };
+
+			buf_u8(&op.code, BC_OP_HOME);
+			ops_push(ops, op);
+		} else if (strcmp(cmd, "ARC") == 0) {
+			long v[3];
+			uint8_t buttons = parse_coords(p, cmd, args, v, 3);
+
+			emit_path(ops, BC_OP_ARC, buttons, v, 3);
+		} else if (strcmp(cmd, "CURVE") == 0) {
+			long v[6];
+			uint8_t buttons = parse_coords(p, cmd, args, v, 6);
+
+			emit_path(ops, BC_OP_CURVE, buttons, v, 6);
+		} else if (strcmp(cmd, "ROTATE") == 0) {
+			emit_u8(ops, BC_OP_ROTATE, parse_number(p, args, 0, UINT8_MAX));
+		} else if (strcmp(cmd, "TERMINAL") == 0) {
+			emit_combo(ops, MOD_LCTRL | MOD_LALT, USAGE_T);
+		} else if (strcmp(cmd, "URL") == 0) {
+			emit_url(p, ops, args, strlen(args));
+		} else if (strcmp(cmd, "LAYOUT") == 0) {
+			const struct keymap_layout *layout = find_layout(args);
+
+			if (layout == NULL) {
+				die(p, "unknown layout '%s'", args);
+			}
+			p->map = layout->map;
+		} else if (strcmp(cmd, "PACE") == 0) {
+			emit_u16(ops, BC_OP_PACE, parse_number(p, args, 0, UINT16_MAX));
+		} else if (strcmp(cmd, "PACK") == 0) {
+			emit_u8(ops, BC_OP_PACK, parse_number(p, args, 1, p->max_pack));
+		} else if (strcmp(cmd, "REPEAT") == 0) {
+			long count = parse_number(p, args, 1, UINT8_MAX);
+			int start = p->lineno;
+			struct ops body = { 0 };
+			struct buf code = { 0 };
+
+			if (depth + 1 >= BC_MAX_DEPTH) {
+				die(p, "REPEAT nested deeper than %d", BC_MAX_DEPTH - 1);
+			}
+			parse_block(p, &body, depth + 1);
+			optimize(&body, depth + 1);
+			serialize(&body, 0, body.n, &code);
+			if (code.len > UINT16_MAX) {
+				die(p, "REPEAT body from line %d too large", start);
+			}
+			emit_repeat(ops, count, &code, ops_depth(&body, 0, body.n));
+			ops_free(&body);
+			free(code.data);
+		} else if (strcmp(cmd, "END") == 0) {
+			if (depth == 0) {
+				die(p, "END without REPEAT");
+			}
+			return;
+		} else if (*args == '\0' && named_key(cmd, &usage)) {
+			emit_key(ops, 0, usage);
+		} else {
+			die(p, "unknown command '%s'", cmd);
+		}
+	}
+
+	if (depth > 0) {
+		die(p, "missing END");
+	}
+}
+
+/* ============================ estimator ============================ */
+
+/*
+ * Walks the encoded program like bc_run() and counts reports the way the
+ * firmware's keyboard stream (src/kbd.c) emits them, boot protocol assumed.
+ */
+struct estimate {
+	unsigned int pack;
+	unsigned int pace_ms;
+	uint8_t held_mods;
+	uint8_t held[KBD_BOOT_SLOTS];
+	uint8_t held_n;
+	uint8_t batch_mods;
+	uint8_t batch[KBD_BOOT_SLOTS];
+	uint8_t batch_n;
+	double ms;
+	unsigned long long reports;
+	/* Pointer from the origin, for MOVETO */
+	long mouse_x;
+	long mouse_y;
+};
+
+static void est_report(struct estimate *e)
+{
+	e->reports++;
+	/* One report per 1 ms poll interval unless a slower pace is set */
+	e->ms += e->pace_ms > 1 ? e->pace_ms : 1;
+}
+
+static void est_flush(struct estimate *e)
+{
+	if (e->batch_n > 0) {
+		est_report(e);
+		e->held_mods = e->batch_mods;
+		memcpy(e->held, e->batch, e->batch_n);
+		e->held_n = e->batch_n;
+		e->batch_n = 0;
+	}
+}
+
+static void est_tap(struct estimate *e, uint8_t mods, uint8_t usage)
+{
+	if (e->batch_n > 0 && (mods != e->batch_mods || memchr(e->batch, usage, e->batch_n) ||
+			       memchr(e->held, usage, e->held_n))) {
+		est_flush(e);
+	}
+	if (e->batch_n == 0) {
+		if (e->held_n > 0 && (mods != e->held_mods || memchr(e->held, usage, e->held_n))) {
+			est_report(e);
+			e->held_n = 0;
+			e->held_mods = mods;
+		}
+		e->batch_mods = mods;
+	}
+	e->batch[e->batch_n++] = usage;
+	if (e->batch_n >= e->pack) {
+		est_flush(e);
+	}
+}
+
+static void est_release(struct estimate *e)
+{
+	est_flush(e);
+	if (e->held_n > 0 || e->held_mods != 0) {
+		est_report(e);
+		e->held_n = 0;
+		e->held_mods = 0;
+	}
+}
+
+static int16_t get_s16(const uint8_t *pc)
+{
+	return (int16_t)(pc[0] | pc[1] << 8);
+}
+
+/* Reports of a path, sent one per poll interval like the device does */
+static void est_path(struct estimate *e, struct path *path)
+{
+	uint32_t steps = path_steps(path);
+	int32_t x = 0;
+	int32_t y = 0;
+
+	while (path_next(path, &x, &y)) {
+	}
+	e->mouse_x += x;
+	e->mouse_y += y;
+
+	steps = steps > 0 ? steps : 1;
+	e->reports += steps;
+	e->ms += steps;
+}
+
+static void est_line(struct estimate *e, long dx, long dy)
+{
+	struct path path;
+
+	dx = dx < INT16_MIN ? INT16_MIN : dx > INT16_MAX ? INT16_MAX : dx;
+	dy = dy < INT16_MIN ? INT16_MIN : dy > INT16_MAX ? INT16_MAX : dy;
+	path_line(&path, dx, dy);
+	est_path(e, &path);
+}
+
+/* Runs the program as the device would, depth being the REPEATs around it */
+static void est_run(struct estimate *e, const uint8_t *pc, const uint8_t *end, int depth)
+{
+	while (pc < end) {
+		uint8_t op = *pc++;
+
+		switch (op) {
+		case BC_OP_END:
+			return;
+		case BC_OP_KEYS:
+			for (uint8_t n = *pc++; n > 0; n--, pc += 2) {
+				est_tap(e, pc[0], pc[1]);
+			}
+			break;
+		case BC_OP_COMBO:
+			est_tap(e, pc[0], pc[1]);
+			est_release(e);
+			pc += 2;
+			break;
+		case BC_OP_RELEASE:
+			est_release(e);
+			break;
+		case BC_OP_DELAY:
+			est_release(e);
+			e->ms += pc[0] | pc[1] << 8;
+			pc += 2;
+			break;
+		case BC_OP_MOUSE:
+			est_line(e, get_s16(&pc[1]), get_s16(&pc[3]));
+			pc += 5;
+			break;
+		case BC_OP_HOME:
+			est_line(e, -MOUSE_HOME_TRAVEL, -MOUSE_HOME_TRAVEL);
+			e->mouse_x = 0;
+			e->mouse_y = 0;
+			break;
+		case BC_OP_MOVETO:
+			est_line(e, get_s16(&pc[1]) - e->mouse_x, get_s16(&pc[3]) - e->mouse_y);
+			pc += 5;
+			break;
+		case BC_OP_ARC: {
+			struct path path;
+
+			path_arc(&path, get_s16(&pc[1]), get_s16(&pc[3]), get_s16(&pc[5]));
+			est_path(e, &path);
+			pc += 7;
+			break;
+		}
+		case BC_OP_CURVE: {
+			struct path path;
+
+			path_curve(&path, get_s16(&pc[1]), get_s16(&pc[3]), get_s16(&pc[5]),
+				   get_s16(&pc[7]), get_s16(&pc[9]), get_s16(&pc[11]));
+			est_path(e, &path);
+			pc += 13;
+			break;
+		}
+		case BC_OP_ROTATE:
+			/* Circles run in the background, the program goes on */
+			est_release(e);
+			pc++;
+			break;
+		case BC_OP_REPEAT: {
+			uint8_t count = pc[0];
+			uint16_t len = pc[1] | pc[2] << 8;
+
+			pc += 3;
+			/* The device rejects the whole program, not just this block */
+			if (depth + 1 > BC_MAX_DEPTH) {
+				die(NULL, "internal error: REPEAT nested deeper than %d", BC_MAX_DEPTH);
+			}
+			for (; count > 0; count--) {
+				est_run(e, pc, pc + len, depth + 1);
+			}
+			pc += len;
+			break;
+		}
+		case BC_OP_LAYOUT:
+			pc += 1 + *pc;
+			break;
+		case BC_OP_PACE:
+			e->pace_ms = pc[0] | pc[1] << 8;
+			pc += 2;
+			break;
+		case BC_OP_PACK:
+			e->pack = *pc > KBD_BOOT_SLOTS ? KBD_BOOT_SLOTS : *pc;
+			pc++;
+			break;
+		default:
+			die(NULL, "internal error: opcode 0x%02x", op);
+		}
+	}
+}
+
+/* ============================ main ============================ */
+
+/* CRC-32 (IEEE), as the device computes it to key the payload cache */
+static uint32_t crc32(const uint8_t *data, size_t len)
+{
+	uint32_t crc = 0xFFFFFFFF;
+
+	for (size_t i = 0; i < len; i++) {
+		crc ^= data[i];
+		for (int bit = 0; bit < 8; bit++) {
+			crc = (crc >> 1) ^ (0xEDB88320 & -(crc & 1));
+		}
+	}
+
+	return ~crc;
+}
+
+static void put_le32(uint8_t *dst, uint32_t v)
+{
+	for (int i = 0; i < 4; i++) {
+		dst[i] = v >> (8 * i);
+	}
+}
+
+/* Greedy LZSS, the window is small enough to search it all */
+static void lz_compress(const struct buf *in, struct buf *out)
+{
+	size_t flag_pos = 0;
+	int items = 8;
+
+	buf_u8(out, LZ_MAGIC);
+
+	for (size_t pos = 0; pos < in->len;) {
+		size_t best_len = 0;
+		size_t best_off = 0;
+		size_t max = MIN(in->len - pos, (size_t)LZ_MAX_MATCH);
+
+		for (size_t off = 1; off <= MIN(pos, (size_t)LZ_WINDOW_SIZE); off++) {
+			size_t n = 0;
+
+			while (n < max && in->data[pos - off + n] == in->data[pos + n]) {
+				n++;
+			}
+			if (n > best_len) {
+				best_len = n;
+				best_off = off;
+			}
+		}
+
+		if (items == 8) {
+			flag_pos = out->len;
+			buf_u8(out, 0);
+			items = 0;
+		}
+
+		if (best_len >= LZ_MIN_MATCH) {
+			out->data[flag_pos] |= 1 << items;
+			buf_u8(out, (best_off - 1) & 0xFF);
+			buf_u8(out, ((best_len - LZ_MIN_MATCH) << 2) | ((best_off - 1) >> 8));
+			pos += best_len;
+		} else {
+			buf_u8(out, in->data[pos++]);
+		}
+		items++;
+	}
+}
+
+static size_t lz_check_out(const uint8_t *data, size_t len, bool last, void *ctx)
+{
+	struct buf *b = ctx;
+
+	(void)last;
+	buf_put(b, data, len);
+
+	return len;
+}
+
+/* Decode with the device's decoder and make sure the payload comes back */
+static void lz_check(const struct buf *orig, const struct buf *packed)
+{
+	static struct lz_dec dec;
+	struct buf check = { 0 };
+	size_t used;
+
+	lz_init(&dec);
+	if (lz_feed(&dec, &packed->data[1], packed->len - 1, true, lz_check_out, &check,
+		    &used) != 0 ||
+	    check.len != orig->len || memcmp(check.data, orig->data, orig->len) != 0) {
+		die(NULL, "internal error: compressed payload does not decode");
+	}
+	free(check.data);
+}
+
+static void print_hex(const uint8_t *data, size_t len)
+{
+	for (size_t i = 0; i < len; i++) {
+		printf("%02X", data[i]);
+	}
+	printf("\n");
+}
+
+/* Split the payload into chunks of at most write_max bytes, returns the count */
+static size_t print_chunks(const struct buf *payload, bool hex, size_t write_max)
+{
+	size_t per_chunk = write_max - STREAM_HDR_SIZE;
+	size_t count = 0;
+	uint8_t chunk[DEVICE_WRITE_MAX];
+
+	for (size_t off = 0; off < payload->len || count == 0; off += per_chunk, count++) {
+		size_t n = MIN(per_chunk, payload->len - off);
+
+		chunk[0] = STREAM_MAGIC;
+		chunk[1] = (uint8_t)count;
+		chunk[2] = (off == 0 ? STREAM_FLAG_START : 0) |
+			   (off + n == payload->len ? STREAM_FLAG_END : 0);
+		memcpy(&chunk[STREAM_HDR_SIZE], &payload->data[off], n);
+		if (hex) {
+			print_hex(chunk, STREAM_HDR_SIZE + n);
+		}
+	}
+
+	return count;
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr,
+		"usage: %s [-l layout] [-o payload.bin] [-x] [-c] [-s] [-z] [-m mtu] [-n] script\n"
+		"  -l  layout the host uses (default %s)\n"
+		"  -o  write the binary payload to a file\n"
+		"  -x  print the payload as hex on stdout\n"
+		"  -c  split the payload into stream chunks of one write each\n"
+		"  -s  wrap the payload in a cache store command\n"
+		"  -z  compress the payload\n"
+		"  -m  ATT MTU of the transfer (default 247)\n"
+		"  -n  the device has NKRO, PACK goes up to %d keys instead of %d\n",
+		prog, DEFAULT_LAYOUT, KBD_NKRO_MAX_KEYS, KBD_BOOT_SLOTS);
+	exit(EXIT_FAILURE);
+}
+
+int main(int argc, char **argv)
+{
+	struct parser p = { .map = find_layout(DEFAULT_LAYOUT)->map, .max_pack = KBD_BOOT_SLOTS };
+	struct estimate est = { .pack = 1 };
+	const char *out_path = NULL;
+	struct ops ops = { 0 };
+	struct buf payload = { 0 };
+	bool hex = false;
+	bool chunked = false;
+	bool cached = false;
+	bool compress = false;
+	uint8_t cmd[CACHE_HDR_SIZE];
+	long mtu = 247;
+	size_t writes;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "l:o:xcszm:nh")) != -1) {
+		switch (opt) {
+		case 'l': {
+			const struct keymap_layout *layout = find_layout(optarg);
+
+			if (layout == NULL) {
+				die(NULL, "unknown layout '%s'", optarg);
+			}
+			p.map = layout->map;
+			break;
+		}
+		case 'o':
+			out_path = optarg;
+			break;
+		case 'x':
+			hex = true;
+			break;
+		case 'c':
+			chunked = true;
+			break;
+		case 's':
+			cached = true;
+			break;
+		case 'z':
+			compress = true;
+			break;
+		case 'm':
+			mtu = parse_number(NULL, optarg, 23, 517);
+			break;
+		case 'n':
+			p.max_pack = KBD_NKRO_MAX_KEYS;
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+	if (optind != argc - 1) {
+		usage(argv[0]);
+	}
+
+	p.path = argv[optind];
+	p.in = strcmp(p.path, "-") == 0 ? stdin : fopen(p.path, "r");
+	if (p.in == NULL) {
+		die(NULL, "cannot open %s: %s", p.path, strerror(errno));
+	}
+
+	parse_block(&p, &ops, 0);
+	optimize(&ops, 0);
+
+	buf_u8(&payload, BC_MAGIC);
+	serialize(&ops, 0, ops.n, &payload);
+
+	est_run(&est, &payload.data[1], &payload.data[payload.len], 0);
+	est_release(&est);
+
+	if (compress) {
+		struct buf packed = { 0 };
+
+		lz_compress(&payload, &packed);
+		lz_check(&payload, &packed);
+		fprintf(stderr, "compressed %zu to %zu bytes\n", payload.len, packed.len);
+		free(payload.data);
+		payload = packed;
+	}
+
+	if (cached) {
+		struct buf store = { 0 };
+		uint32_t hash = crc32(payload.data, payload.len);
+
+		cmd[0] = CACHE_MAGIC;
+		cmd[1] = CACHE_OP_STORE;
+		put_le32(&cmd[2], hash);
+		buf_put(&store, cmd, sizeof(cmd));
+		buf_put(&store, payload.data, payload.len);
+		free(payload.data);
+		payload = store;
+
+		cmd[1] = CACHE_OP_PLAY;
+		fprintf(stderr, "hash %08X, play with ", hash);
+		for (size_t i = 0; i < sizeof(cmd); i++) {
+			fprintf(stderr, "%02X", cmd[i]);
+		}
+		fprintf(stderr, "\n");
+	}
+
+	if (out_path != NULL) {
+		FILE *out = fopen(out_path, "wb");
+
+		if (out == NULL || fwrite(payload.data, 1, payload.len, out) != payload.len ||
+		    fclose(out) != 0) {
+			die(NULL, "cannot write %s", out_path);
+		}
+	}
+	if (chunked) {
+		writes = print_chunks(&payload, hex, MIN(mtu - 3, DEVICE_WRITE_MAX));
+	} else {
+		if (hex) {
+			print_hex(payload.data, payload.len);
+		}
+		if (payload.len > DEVICE_WRITE_MAX) {
+			fprintf(stderr, "warning: payload larger than %d bytes, send it with -c\n",
+				DEVICE_WRITE_MAX);
+		}
+		writes = (payload.len + mtu - 4) / (mtu - 3);
+	}
+
+	fprintf(stderr, "%zu bytes, %zu write(s) at MTU %ld, ~%llu reports, ~%.0f ms to play\n",
+		payload.len, writes, mtu, est.reports, est.ms);
+
+	ops_free(&ops);
+	free(payload.data);
+
+	return 0;
+}